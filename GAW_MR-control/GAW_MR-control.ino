@@ -47,9 +47,60 @@
  *            seems to be more dependable
  *   1.5    Improved straight - thrown states
  *          Improved timing with activateState routine
+ *   1.6    Switch addresses looked up through a sorted index
+ *          Fixed out of bounds read for unknown switch addresses
+ *   1.7    Non blocking activateState, switches are synced from loop()
+ *            while keys and Loconet messages are still being handled
+ *   1.8    Differential sync, only switches that differ from the state
+ *            known to the command station are sent
+ *   1.9    LED changes collected in shadow registers and written
+ *            with one I2C transaction per multiplexer
+ *   1.10   Multiplexers initialized with one I2C transaction each,
+ *            dead multiplexers are reported
+ *   1.11   LCD output through a frame buffer, only changes are sent
+ *   1.12   LCD output sent from loop(), a few characters per pass
+ *   1.13   LCD routines without String objects, fixed width fields
+ *          SRAM usage report
+ *   1.14   Status messages disappear by themselves, no more delays
+ *   1.15   Loconet messages sent from a queue, with priorities
+ *   1.16   Queued requests for the same switch are merged
+ *   1.17   Switch requests are only repeated when no echo comes back,
+ *            LEDs of unconfirmed switches blink
+ *   1.18   Loconet output paced by a token bucket, instead of fixed
+ *            delays in activateState, adjustable over serial
+ *   1.19   Loconet pace adapts to the echo time of the command station
+ *   1.20   Routes, setting several switches with one button
+ *   1.21   Interlocking, a set route locks its switches and blocks
+ *            conflicting routes
+ *   1.22   Switch states also kept in bitmaps, for LEDs, EEPROM and sync
+ *          EEPROM layout changed, store the state once after updating
+ *   1.23   Element definitions in flash, only their states in SRAM
+ *          EEPROM layout changed, store the state once after updating
+ *   1.24   Element fields sized to their values, 6 bytes per definition
+ *          and 2 bytes of state. EEPROM layout changed, store once
+ *   1.25   Element table and keys checked by the compiler, index range
+ *          per element type
+ *   1.26   I2C traffic counted per device and caller, with bus time
+ *   1.27   Histogram of loop() times, per handler, serial command 'l'
+ *   1.28   Key press to Loconet and LED traces, serial command 'k'
+ *   1.29   Switches confirmed by the command station's report, not by
+ *          the echo of our own request
+ *          Loconet pace follows the time to the report, at most
+ *          TX_WINDOW switch requests waiting for one
+ *          Switch states stored in EEPROM only as the bitmap
+ *          Initial screen shown for its full time again
+ *          A retry sends the wanted switch state, not the one sent last
+ *          Wait for a switch report follows the measured report time
+ *          Late switch reports count in the report time
+ *          Sync queries are not paced, only answered ones
+ *          Loconet send makes one try per loop(), no more waiting for
+ *            the line, a dropped switch request is tried again later
+ *          Recalling the state releases all routes
+ *          loop() timing and key traces off by default, see
+ *            LOOP_PROFILE and KEY_TRACE
  *
  *------------------------------------------------------------------------- */
-#define progVersion "1.5"                  // Program version definition
+#define progVersion "1.29"                  // Program version definition
 /* ------------------------------------------------------------------------- *
  *             GNU LICENSE CONDITIONS
  * ------------------------------------------------------------------------- *
@@ -87,8 +138,18 @@
 #include "GAW_debugging.h"                  // Debugging level code
 #include "GAW_MR_defines.h"                 // various definitions
 #include "GAW_MR_layout.h"                  // Define the layout
+#include "GAW_MR_bitmap.h"                  // Switch state bitmaps
+#include "GAW_MR_lookup.h"                  // Switch address index
+#include "GAW_MR_interlocking.h"            // Route conflict tables
+#include "GAW_MR_i2c.h"                     // I2C traffic accounting
+#include "GAW_MR_looptime.h"                // loop() timing histogram
+#include "GAW_MR_keytrace.h"                // Key press latency traces
 #include "GAW_MR_multiplexer.h"             // MCP23017 boards definitions
 #include "GAW_MR_controlpanel.h"            // Controlpanel definitions
+#include "GAW_MR_display.h"                 // LCD frame buffer
+#include "GAW_MR_memory.h"                  // SRAM usage report
+#include "GAW_MR_confirm.h"                 // Switch confirmation
+#include "GAW_MR_txqueue.h"                 // Loconet send queue
 
 /* ------------------------------------------------------------------------- *
  *                                       Global variables needed for Loconet
@@ -97,10 +158,36 @@ lnMsg *LnPacket;
 int SwitchDirection;
 
 
+/* ------------------------------------------------------------------------- *
+ *                                        Global variables needed for Serial
+ * ------------------------------------------------------------------------- */
+char serialLine[SERIAL_LINE];               // Command being received
+byte serialLen = 0;
+
+
+/* ------------------------------------------------------------------------- *
+ *                           Global variables needed for state synchronizing
+ * ------------------------------------------------------------------------- */
+byte syncPhase = SYNC_IDLE;                 // Where are we in the sync
+int  syncIndex = 0;                         // Next element to consider
+int  syncCount = 0;                         // Switches sent so far
+unsigned long syncPrev = 0;                 // Time of last sync action
+unsigned long syncWait = 0;                 // Time to wait after that
+int  syncQuery = NOT_FOUND;                 // Switch with outstanding query
+
+
+/* ------------------------------------------------------------------------- *
+ *                                          Global variables needed for Routes
+ * ------------------------------------------------------------------------- */
+int routeIndex = NOT_FOUND;                 // Route being set, only one
+unsigned long routePressed = 0;             // millis() when it was pressed
+
+
 /* ------------------------------------------------------------------------- *
  *                                                   Initial routine setup()
  * ------------------------------------------------------------------------- */
 void setup() {
+  I2C_CALLER(I2C_SETUP);                    // Count I2C traffic for setup
 
   pinMode(POWERLED, OUTPUT);                // Power indicator LED
 
@@ -108,6 +195,8 @@ void setup() {
 
   display.init();                           // Initialize LCD display
   display.backlight();                      // Backlights on by default
+  i2cCount(I2C_LCD_ADDRESS, LCD_I2C_INIT, LCD_I2C_INIT);
+  lcdInit();                                // Empty frame buffer
 
   doInitialScreen(1);                       // Show for x seconds
 
@@ -120,20 +209,37 @@ void setup() {
   debugln(F("==============================="));
   debug("MemSize   = "); debugln(memSize);
   debug("entrySize = "); debugln(entrySize);
+  debug("flashSize = "); debugln(sizeof(elementDef));
   debug("tableSize = "); debugln(sizeof(element));
+  debug("SRAM saved= "); debugln(sizeof(elementDef) - sizeof(element));
   debug("nElements = "); debugln(nElements);
 
+  elementDefaults();                        // Initial element states
+  buildSwitchIndex();                       // Switch address index
+
   debugln(F("==============================="));
   debugln(F("Initializing multiplexers:"));
 
+  int mxFailed = 0;
   for (int mx=0; mx<numberOfMx; mx++) {
+    unsigned long start = micros();
+    bool ok = mcpInit(mx);
+    unsigned long took = micros() - start;
+
     debug(F(" #")); debug(mx);
-    mcps[mx].mcp.begin_I2C(mcps[mx].address);
-    for (int j = 0; j < 16; j++) {
-      mcps[mx].mcp.pinMode(j, OUTPUT);
+    debug(F(" 0x")); debugfmt(mcps[mx].address, HEX);
+    debug(ok ? F(" ok, ") : F(" FAILED, "));
+    debug(took); debugln(F(" us"));
+
+    if (!ok) {
+      mxFailed++;
+      LCD_field<LCD_COLS>(2, 0, F("Mux 0x   failed"));
+      LCD_number<2>(2, 6, mcps[mx].address, HEX);
     }
   }
-  debugln(); 
+  if (mxFailed) {
+    debug(mxFailed); debugln(F(" multiplexer(s) FAILED"));
+  }
 
   debugln(F("==============================="));
   debugln(F("Initialize LocoNet"));
@@ -145,16 +251,17 @@ void setup() {
 //  storeState();                             // to replace it with the definitions in the code
 //  exit(0);
 
-  LCD_display(display, 1, 0, F("                    "));
+  LCD_field<LCD_COLS>(1, 0, F(""));
   recallState();                            // By default recall state from EEPROM
 
   debugln("Activating state to layout");
-  activateState();                          // Activate recalled state
+  activateState();                          // Start activating recalled state
 
-  LCD_display(display, 0, 0, F("System ready        "));
+  LCD_field<LCD_COLS>(0, 0, F("System ready"));
 
   debugln(F("==============================="));
   debugln(F("Setup done, ready for operations"));
+  memReport();
   debugln(F("==============================="));
 
 /* =========================================
@@ -190,17 +297,83 @@ void setup() {
  *                                                     Repeating code loop()
  * ------------------------------------------------------------------------- */
 void loop() {
+  LOOP_BEGIN();                             // Time of the previous pass
 
   LnPacket = LocoNet.receive();             // Process incoming Loconet msgs
   if (LnPacket) {
+    LOOP_TAG(LT_LOCONET);
     LocoNet.processSwitchSensorMessage(LnPacket);
+    if (LnPacket->data[0] == OPC_LONG_ACK) {
+      handleLongAck(LnPacket);              //  not handled by the library
+    }
   }
 
   char key = controlPanel.getKey();         // Process keypress
   if(key) {                                 // Check for a valid key
+    LOOP_TAG(LT_KEYS);
+    ktKey(key - 1);                         // Trace starts at the press
     handleKeys(key);                        //   and handle key
+    ktHandled();
   }
 
+  handleSerial();                           // Process serial commands
+
+  syncState();                              // Next step of state sync
+
+  confirmCheck();                           // Retry unconfirmed switches
+
+  routeCheck();                             // Route completely set?
+
+  txSend();                                 // Send next Loconet message
+
+  mcpFlush();                               // Write changed LEDs
+
+  lcdNotices();                             // Remove expired messages
+  lcdFlush(LCD_BUDGET);                     // Some of the LCD changes
+
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            handleSerial()
+ * Commands over serial, one per line:
+ *   r<n>  - set Loconet rate to n messages per second
+ *   b<n>  - set Loconet burst to n messages
+ *   a<n>  - adaptive Loconet rate off (0) or on (1)
+ *   s     - show statistics and elements (as FUNC_SHOW)
+ *   l     - show and restart loop() timing
+ *   k     - show key press traces
+ * ------------------------------------------------------------------------- */
+void handleSerial() {
+#if DEBUG_LVL > 0
+  while (Serial.available()) {
+    LOOP_TAG(LT_SERIAL);
+    char c = Serial.read();
+
+    if (c != '\n' && c != '\r') {           // Collect the line
+      if (serialLen < SERIAL_LINE - 1) serialLine[serialLen++] = c;
+      continue;
+    }
+    if (serialLen == 0) continue;           // Empty line
+
+    serialLine[serialLen] = '\0';
+    int value = atoi(&serialLine[1]);
+
+    switch (serialLine[0]) {
+      case 'r': txSetRate(value, 0); break;
+      case 'b': txSetRate(0, value); break;
+      case 'a': txAdaptive = value; txSetRate(0, 0); break;
+      case 's': showElements(); break;
+      case 'l': loopStats(); break;
+      case 'k': ktStats(); break;
+      default:
+        debugln(F("Commands: r<rate>, b<burst>, a<0/1>, s, l, k"));
+        break;
+    }
+    serialLen = 0;
+  }
+#endif
 }
 
 
@@ -213,7 +386,7 @@ void handleKeys(char key) {
 
   int index = key - 1;                      // Convert keycode to table index
 
-  switch(element[index].type) {             // Which type do we have?
+  switch(elemType(index)) {             // Which type do we have?
 
     case TYPE_SWITCH:                       // SWITCH TYPE
       flipSwitch(index);
@@ -223,6 +396,10 @@ void handleKeys(char key) {
       handleLocomotive(index);
       break;
 
+    case TYPE_ROUTE:                        // ROUTE TYPE
+      handleRoute(index);
+      break;
+
     case TYPE_FUNCTION:                     // FUNCTION TYPE
       handleFunction(index);
       break;
@@ -249,15 +426,21 @@ void flipSwitch(int index) {
 #endif
 
 #if DEBUG_LVL > 2
-  debug("--- flipSwitch: set "+String(element[index].address)+" from ");
+  debug("--- flipSwitch: set "+String(elemAddress(index))+" from ");
   if (element[index].state == STRAIGHT) debug(STATE_STRAIGHT); else debug(STATE_THROWN);
   debug(" to " );
 #endif
 
+  if (switchLocked(index)) {                // Part of a route that is set
+    debugln(F("--- flipSwitch:switch locked by route"));
+    lcdNotice(2, 0, F("Switch locked       "), NOTICE_TIME);
+    return;
+  }
+
   if (element[index].state == STRAIGHT) {
-    element[index].state = THROWN;
+    swWant(index, THROWN);
   } else {
-    element[index].state = STRAIGHT;
+    swWant(index, STRAIGHT);
   }
 
 #if DEBUG_LVL > 2
@@ -275,15 +458,127 @@ void flipSwitch(int index) {
  * ------------------------------------------------------------------------- */
 void setSwitch(int index) {
 #if DEBUG_LVL > 1
-    debugln("setSwitch " + String(element[index].address) + " to " + ( element[index].state == STRAIGHT ? STATE_STRAIGHT : STATE_THROWN ) );
+    debugln("setSwitch " + String(elemAddress(index)) + " to " + ( element[index].state == STRAIGHT ? STATE_STRAIGHT : STATE_THROWN ) );
 #endif 
 
                                             // Current way for our switches
-  sendOPC_SW_REQ(element[index].address - 1, element[index].state, 1);
+  sendOPC_SW_REQ(elemAddress(index) - 1, element[index].state, 1);
 
                                             // Old way for solenoid switches
-//  setLNTurnout(element[index].address, element[index].state);
+//  setLNTurnout(elemAddress(index), element[index].state);
+
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          routeFirstStep()
+ * Returns the index in routeSteps[] of the first step of a route
+ * ------------------------------------------------------------------------- */
+int routeFirstStep(int route) {
+  int step = 0;
+  for (int r = 1; r < route; r++) {         // Skip the routes before it
+    while (pgm_read_byte(&routeSteps[step].sw) != ROUTE_END_SW) step++;
+    step++;
+    if (step >= (int)(sizeof(routeSteps) / sizeof(ROUTE_STEP))) return NOT_FOUND;
+  }
+  return step;
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             handleRoute()
+ * Set all switches of a route. Only the switches that are not in the
+ * right state yet are sent, they all go into the Loconet send queue at
+ * once. routeCheck() measures the time until they are all confirmed.
+ * It follows one route only: pressing another route before that one is
+ * set stops the measurement for it, its locks stay.
+ * The route then locks its switches, until its button is pressed again.
+ * A route conflicting with a route that is set is blocked.
+ * ------------------------------------------------------------------------- */
+void handleRoute(int index) {
+  int route = elemAddress(index);
+  int step  = routeFirstStep(route);
+  if (step == NOT_FOUND || route < 1 || route > nRoutes) {
+    debug(F("--- handleRoute:Route ")); debug(route); debugln(F(" not defined"));
+    return;
+  }
+
+  LCD_field<6>(2, 0, F("Route"));
+  LCD_number<2>(2, 6, route);
+
+  if (routeIsSet(route)) {                  // Pressed again: release
+    routeRelease(route);
+    debug(F("Route ")); debug(route); debugln(F(" released"));
+    LCD_field<12>(2, 8, F(" released"));
+    return;
+  }
 
+  if (routeBlocked(route)) {                // Conflicts with a set route
+    debug(F("Route ")); debug(route); debugln(F(" blocked"));
+    LCD_field<12>(2, 8, F(" blocked"));
+    return;
+  }
+  routeLock(route);
+
+  int changed = 0;
+  for (; pgm_read_byte(&routeSteps[step].sw) != ROUTE_END_SW; step++) {
+    int  sw    = pgm_read_byte(&routeSteps[step].sw);
+    byte state = pgm_read_byte(&routeSteps[step].state);
+
+    if (element[sw].state != state || !csKnows(sw, state)) {
+      swWant(sw, state);
+      setSwitch(sw);
+      changed++;
+    }
+  }
+
+  debug(F("Route ")); debug(route);
+  debug(F(", switches to set: ")); debugln(changed);
+
+  routeIndex = index;
+  routePressed = millis();
+  LCD_field<12>(2, 8, F(" setting"));
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                              routeCheck()
+ * When all switches of the route being set are confirmed, show how long
+ * it took from the button press
+ * ------------------------------------------------------------------------- */
+void routeCheck() {
+  if (routeIndex == NOT_FOUND) return;      // Quick exit
+
+  int route = elemAddress(routeIndex);
+  bool failed = false;
+  for (int step = routeFirstStep(route); 
+       pgm_read_byte(&routeSteps[step].sw) != ROUTE_END_SW; step++) {
+    int  sw    = pgm_read_byte(&routeSteps[step].sw);
+    byte state = pgm_read_byte(&routeSteps[step].state);
+
+    if (cfTries[sw] == CONFIRM_FAILED) {
+      failed = true;
+    } else if (cfTries[sw] != 0 || !csKnows(sw, state)) {
+      return;                               // Not yet
+    }
+  }
+
+  unsigned long took = millis() - routePressed;
+  routeIndex = NOT_FOUND;
+
+  debug(F("Route ")); debug(route);
+  debug(failed ? F(" FAILED after ms: ") : F(" set in ms: ")); debugln(took);
+
+  if (failed) {
+    LCD_field<12>(2, 8, F(" failed"));
+  } else {
+    LCD_field<5>(2, 8, F(" set"));
+    LCD_number<5>(2, 13, took);
+    LCD_field<2>(2, 18, F("ms"));
+  }
 }
 
 
@@ -293,9 +588,10 @@ void setSwitch(int index) {
  * ------------------------------------------------------------------------- */
 void handleLocomotive(int index) {
   debug("Loc # ");                                // Just display address
-  debug(element[index].address);                //   for future use
+  debug(elemAddress(index));                //   for future use
   activeLoc = index;
-  LCD_display(display, 1, 0, "Loc "+String(element[activeLoc].address)+"            ");
+  LCD_field<LCD_COLS>(1, 0, F("Loc "));
+  LCD_number<4>(1, 4, elemAddress(activeLoc));
 
   setLocSpeed(index);                             //   for future use
 }
@@ -309,8 +605,8 @@ void setLocSpeed(int index) {
   byte direction = element[activeLoc].state;
   int  speedstep = element[activeLoc].state2;
 
-  debug(" set to " + direction == FORWARD ? " forward" : " reverse" );
-  debug(", speed: " + String(speedstep) );
+  debug(direction == FORWARD ? F(" set to forward") : F(" set to reverse") );
+  debug(F(", speed: ")); debug(speedstep);
   debugln();
 
 // SET LOCONET COMMAND TO Z21
@@ -323,7 +619,7 @@ void setLocSpeed(int index) {
  *                                                          handleFunction()
  * ------------------------------------------------------------------------- */
 void handleFunction(int index) {
-  int function = element[index].address;
+  int function = elemAddress(index);
 
   switch(function) {
 
@@ -374,10 +670,11 @@ void handleFunction(int index) {
 void locForward() {
   if (activeLoc > 0) {
     element[activeLoc].state = FORWARD;
-    debugln("Loc #"+String(element[activeLoc].address)+" set to forward");
-    LCD_display(display, 1, 10, "forward   ");
+    debug(F("Loc #")); debug(elemAddress(activeLoc));
+    debugln(F(" set to forward"));
+    LCD_field<10>(1, 10, F("forward"));
   } else {
-    LCD_display(display, 1, 0, F("NO ACTIVE LOC!      "));
+    LCD_field<LCD_COLS>(1, 0, F("NO ACTIVE LOC!"));
     debugln(F("NO ACTIVE LOC!"));
   }
 }
@@ -390,10 +687,11 @@ void locForward() {
 void locStop() {
   if (activeLoc > 0) {
     element[activeLoc].state = STOP;
-    debugln("Loc #"+String(element[activeLoc].address)+" set to stop");
-    LCD_display(display, 1, 10, "stop      ");
+    debug(F("Loc #")); debug(elemAddress(activeLoc));
+    debugln(F(" set to stop"));
+    LCD_field<10>(1, 10, F("stop"));
   } else {
-    LCD_display(display, 1, 0, F("NO ACTIVE LOC!      "));
+    LCD_field<LCD_COLS>(1, 0, F("NO ACTIVE LOC!"));
     debugln("NO ACTIVE LOC!");
   }
 }
@@ -406,10 +704,11 @@ void locStop() {
 void locReverse() {
   if (activeLoc > 0) {
     element[activeLoc].state = REVERSE;
-    debugln("Loc #"+String(element[activeLoc].address)+" set to reverse");
-    LCD_display(display, 1, 10, "reverse   ");
+    debug(F("Loc #")); debug(elemAddress(activeLoc));
+    debugln(F(" set to reverse"));
+    LCD_field<10>(1, 10, F("reverse"));
   } else {
-    LCD_display(display, 1, 0, F("NO ACTIVE LOC!      "));
+    LCD_field<LCD_COLS>(1, 0, F("NO ACTIVE LOC!"));
     debugln("NO ACTIVE LOC!");
   }
 }
@@ -434,8 +733,8 @@ void handlePower(int index) {
   debugln(state == POWEROFF ? F("OFF") : F("ON") );
   state ? digitalWrite(POWERLED, HIGH) : digitalWrite(POWERLED, LOW);
 
-  LCD_display(display, 3,10, "Power: ");
-  LCD_display(display, 3,17, state == POWERON ? "ON " : "OFF");
+  LCD_display(3, 10, F("Power: "));
+  LCD_field<3>(3, 17, state == POWERON ? F("ON") : F("OFF"));
 
 /* --- Send Loconet command to command station (Z21) to set power state ---- */
   sendOPC_GP(state);
@@ -448,13 +747,20 @@ void handlePower(int index) {
  * Testing purposes: show array of elements and their states
  * ------------------------------------------------------------------------- */
 void showElements() {
-  debugln(F("Show elements table:"));
+  txStats();
+  confirmStats();
+  lcdStats();
+  i2cStats();
+  memReport();
+
+  debug(F("Show elements table, bytes per element: definition "));
+  debug(sizeof(MR_data)); debug(F(", state ")); debugln(entrySize);
   for (int i=0; i<nElements; i++) {
-    debug(String(i+1));
+    debug(i+1);
 
     debug(F(" - Type: "));
-    debug(element[i].type);
-    switch (element[i].type) {
+    debug(elemType(i));
+    switch (elemType(i)) {
       case TYPE_SWITCH:
         debug(F(" - Switch: "));
         break;
@@ -462,6 +768,10 @@ void showElements() {
       case TYPE_LOCO:
         debug(F(" - Locomotive: "));
         break;
+
+      case TYPE_ROUTE:
+        debug(F(" - Route: "));
+        break;
         
       case TYPE_FUNCTION:
         debug(F(" - Funtion: "));
@@ -475,26 +785,30 @@ void showElements() {
         break;
     }
     
-    debug(String(element[i].address));
+    debug(elemAddress(i));
     debug(F(" - "));
 
-    switch (element[i].type) {
+    switch (elemType(i)) {
       case TYPE_SWITCH:
-        debug("state="+String(element[i].state) + ", ");
+        debug(F("state=")); debug(element[i].state); debug(F(", "));
         debug(element[i].state  == STRAIGHT ? STATE_STRAIGHT : STATE_THROWN );
         debug(F(" - Module: "));
-        debugln(element[i].module);
+        debugln(elemModule(i));
         break;
 
       case TYPE_LOCO:
-        if (element[i].state == 1) {
+        if ((int8_t)element[i].state == REVERSE) {
           debug("Reverse, ");
-        } else if (element[i].state == 0) {
+        } else if (element[i].state == STOP) {
           debug("Stop, ");
-        } else if (element[i].state == 2) {
+        } else if (element[i].state == FORWARD) {
           debug("Forward, ");
         }
-        debugln("Speed: "+String(element[i].state2));
+        debug(F("Speed: ")); debugln(element[i].state2);
+        break;
+
+      case TYPE_ROUTE:
+        showRoute(elemAddress(i));
         break;
 
       case TYPE_FUNCTION:
@@ -513,11 +827,29 @@ void showElements() {
 }
 
 
+/* ------------------------------------------------------------------------- *
+ *                                                               showRoute()
+ * ------------------------------------------------------------------------- */
+void showRoute(int route) {
+  int step = routeFirstStep(route);
+  if (step == NOT_FOUND) {
+    debugln(F("not defined"));
+    return;
+  }
+  for (; pgm_read_byte(&routeSteps[step].sw) != ROUTE_END_SW; step++) {
+    int sw = pgm_read_byte(&routeSteps[step].sw);
+    debug(elemAddress(sw));
+    debug(pgm_read_byte(&routeSteps[step].state) == STRAIGHT ? F(" straight ") : F(" thrown "));
+  }
+  debugln();
+}
+
+
 /* ------------------------------------------------------------------------- *
  *                                                           showFunctions()
  * ------------------------------------------------------------------------- */
 void showFunctions(int index) {
-  switch (element[index].address) {
+  switch (elemAddress(index)) {
 
     case FUNC_STORE:    debugln("Store state"); break;
     case FUNC_RECALL:   debugln("Recall state"); break;
@@ -539,31 +871,43 @@ void showFunctions(int index) {
 
 /* ------------------------------------------------------------------------- *
  *                                                              storeState()
+ * EEPROM holds the switch bitmap first, then the element states. The
+ * switch states are only kept in the bitmap, their element slots are
+ * not written, recallState() sets element[] from the bitmap.
  * ------------------------------------------------------------------------- */
 void storeState() {
   debugln("Storing system status");
+  EEPROM.put(EE_SWITCHES, swWanted);
   for (int i=0; i<nElements; i++) {
-    EEPROM.put(i*entrySize, element[i]);
+    if (elemType(i) == TYPE_SWITCH) continue; // In the bitmap
+    EEPROM.put(EE_ELEMENTS + i*entrySize, element[i]);
   }
   debugln("System status stored");
-  LCD_display(display, 3, 0, "Stored");
-  delay(1000);
-  LCD_display(display, 3, 0, F("      "));
+  lcdNotice(3, 0, F("Stored  "), NOTICE_TIME);
 }
 
 
 
 /* ------------------------------------------------------------------------- *
  *                                                             recallState()
+ * The route locks are not stored, the recalled switch states may not
+ * match the routes that were set, so they are all released.
  * ------------------------------------------------------------------------- */
 void recallState() {
   debugln("Recalling system status");
+  routeReleaseAll();
+  routeIndex = NOT_FOUND;
   for (int i=0; i<nElements; i++) {
-    EEPROM.get(i*entrySize, element[i]);
+    if (elemType(i) == TYPE_SWITCH) continue; // From the bitmap below
+    EEPROM.get(EE_ELEMENTS + i*entrySize, element[i]);
+  }
+
+  uint16_t wanted[SW_WORDS];                // Switch states from bitmap
+  EEPROM.get(EE_SWITCHES, wanted);
+  for (int i = swNext(0, SW_ALL); i != NOT_FOUND; i = swNext(i + 1, SW_ALL)) {
+    swWant(i, swGet(wanted, i) ? STRAIGHT : THROWN);
   }
-  LCD_display(display, 3, 0, "Recalled");
-  delay(1000);
-  LCD_display(display, 3, 0, F("        "));
+  lcdNotice(3, 0, F("Recalled"), NOTICE_TIME);
 
 #if DEBUG_LVL > 1
   showElements();
@@ -575,74 +919,152 @@ void recallState() {
 
 /* ------------------------------------------------------------------------- *
  *                                                           activateState()
+ * Restore the power state and start sending the switch states to the
+ * layout. The switches themselves are sent one by one by syncState(),
+ * called from loop(), so the panel stays responsive in the meantime.
+ * The pace is set by the Loconet send queue (see GAW_MR_txqueue.h).
+ * With SYNC_DIFFERENTIAL the command station is asked first for the
+ * switch states it does not know yet (see swKnown[]), and only the
+ * switches that differ from what we want are sent.
  * ------------------------------------------------------------------------- */
 void activateState() {
 #if DEBUG_LVL > 1
   debug("activateState ");
 #endif
 
-  LCD_display(display, 1, 0, "Sync state          ");
+  LCD_field<LCD_COLS>(1, 0, F("Sync state"));
 
   int pwr = 0;                              // Assume power off
   int index = 0;
 
 
-  for (index = 0; index < nElements; index++) {  // FIRST: restore power state
-    if (element[index].type == 99) {        // Power state found
-        pwr = element[index].state;         // What was the state?
-        setPower(element[index].state);     // Set power on / off
-    }
+  for (index = powerFirst; index <= powerLast; index++) {  // FIRST: power
+    pwr = element[index].state;             // What was the state?
+    setPower(element[index].state);         // Set power on / off
   }
 
+  syncIndex = 0;                            // (Re)start from the top
+  syncCount = 0;
+  syncQuery = NOT_FOUND;
+  syncPrev  = millis();
+  syncWait  = 0;
 
   if (pwr) {                                // Power on? then Switches
-    for (index = 0; index < nElements; index++) {
-      unsigned long prevMillis = millis();
-                                            // Is it a switch?
-                                            //  & address > zero?
-      if (element[index].type == TYPE_SWITCH && element[index].address > 0 ) {
-        LCD_display(display, 1, 15, String(element[index].address) );
+#if SYNC_DIFFERENTIAL
+    syncPhase = SYNC_QUERY;
+#else
+    syncPhase = SYNC_SWITCHES;
+#endif
+  } else {
+    syncPhase = SYNC_DONE;
+  }
 
-#if DEBUG_LVL > 1
-        debug("--- activateState:Setting "+String(element[index].address)+" to ");
-        if (element[index].state == STRAIGHT) debugln(STATE_STRAIGHT); else debugln(STATE_THROWN);
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               syncState()
+ * One step of the state synchronization. A query or switch is only queued
+ * when the previous one has left the switch queue. The next query goes
+ * when the answer to the last one is in, or after SYNC_QUERY_WAIT ms,
+ * queries take no token. The token bucket sets the pace of the switches.
+ * The progress takes row 1 of the display: "Sync state nnnn/nnnn".
+ * ------------------------------------------------------------------------- */
+static_assert(MAX_SWITCHES <= 9999, "sync progress shows at most 4 digits");
+
+void syncState() {
+
+  if (syncPhase == SYNC_IDLE) return;       // Nothing to do
+  if (millis() - syncPrev < syncWait) return;   // Not yet
+  if (txq[TX_SWITCH].count > 0) return;     // Previous one not sent yet
+
+  switch (syncPhase) {
+
+    case SYNC_QUERY:                        // Ask for unknown states
+      syncQuery = NOT_FOUND;                //  previous one answered or not
+      syncIndex = swNext(syncIndex, SW_UNKNOWN);
+
+      if (syncIndex != NOT_FOUND) {
+        syncQuery = syncIndex;
+        sendOPC_SW_STATE(elemAddress(syncIndex) - 1);
+        syncIndex++;
+        syncWait = SYNC_QUERY_WAIT;         // Cut short by handleLongAck()
+
+      } else {                              // All known states gathered
+        syncPhase = SYNC_SWITCHES;
+        syncIndex = 0;
+        syncWait  = 0;
+      }
+      break;
+
+    case SYNC_SWITCHES:
+                                            // Find next switch in use
+                                            //  with a different state
+#if SYNC_DIFFERENTIAL
+      syncIndex = swNext(syncIndex, SW_DIFF);
+#else
+      syncIndex = swNext(syncIndex, SW_ALL);
 #endif
 
-        setSwitch(index);                   //  then set proper value
-        
-        LnPacket = LocoNet.receive();             // process incoming Loconet msgs
-        if (LnPacket) {
-          LocoNet.processSwitchSensorMessage(LnPacket);
-        }
+      if (syncIndex != NOT_FOUND) {
+        syncCount++;
+        LCD_number<4>(1, 11, syncCount);
+        LCD_display(1, 15, F("/"));
+        LCD_number<4>(1, 16, nSwIndex);
 
-        do {} while (millis() - prevMillis < 100 );
+#if DEBUG_LVL > 1
+        debug("--- syncState:Setting "+String(elemAddress(syncIndex))+" to ");
+        if (element[syncIndex].state == STRAIGHT) debugln(STATE_STRAIGHT); else debugln(STATE_THROWN);
+#endif
+
+        setSwitch(syncIndex);               //  then set proper value
+        syncIndex++;
+        syncWait = 0;
 
+      } else {                              // All switches done
+#if DEBUG_LVL > 1
+        debugln("--- syncState:"+String(syncCount)+" of "+String(nSwIndex)+" switches sent");
+#endif
+        syncPhase = SYNC_DONE;
+        syncWait  = SYNC_HOLD;
       }
-    }
+      break;
+
+    case SYNC_DONE:
+      LCD_field<LCD_COLS>(1, 0, F(""));
+      syncPhase = SYNC_IDLE;
+      break;
+
+    default:
+      syncPhase = SYNC_IDLE;
+      break;
+
   }
 
-  delay(1000);
-  LCD_display(display, 1, 0, "                    " );
+  syncPrev = millis();
 
 }
 
 
 
 /* ------------------------------------------------------------------------- *
- *       Show initial screen, then paste template          doInitialScreen()
+ *       Show initial screen for s seconds                 doInitialScreen()
+ * The screen is sent right away, then the display is held for s seconds.
+ * What the startup writes meanwhile is shown when the time is up.
  * ------------------------------------------------------------------------- */
 void doInitialScreen(int s) {
   
-  LCD_display(display, 0, 0, F("GAW-MR-control v    "));
-  LCD_display(display, 0, 16, progVersion);
-  LCD_display(display, 1, 0, F("(c) Gerard Wassink  "));
-  LCD_display(display, 2, 0, F("GNU public license  "));
-
-  delay(s * 1000);
-
-  LCD_display(display, 0, 0, F("                    "));
-  LCD_display(display, 1, 0, F("                    "));
-  LCD_display(display, 2, 0, F("                    "));
+  LCD_field<16>(0, 0, F("GAW-MR-control v"));
+  LCD_field<4>(0, 16, F(progVersion));
+  LCD_field<LCD_COLS>(1, 0, F("(c) Gerard Wassink"));
+  LCD_field<LCD_COLS>(2, 0, F("GNU public license"));
+  lcdFlush(LCD_NO_BUDGET);
+
+  for (int row = 0; row < 3; row++) {       // Gone after the hold,
+    lcdBlank(row, 0, LCD_COLS);             //  unless overwritten
+  }
+  lcdHold(s * 1000UL);
 
 }
 
@@ -650,10 +1072,15 @@ void doInitialScreen(int s) {
 
 /* ------------------------------------------------------------------------- *
  *       Routine to display stuff on the display of choice     LCD_display()
+ * The text goes to the frame buffer, loop() sends it to the display.
+ * Fixed width fields and numbers: see LCD_field<>() and LCD_number<>()
  * ------------------------------------------------------------------------- */
-void LCD_display(LiquidCrystal_I2C screen, int row, int col, String text) {
-    screen.setCursor(col, row);
-    screen.print(text);
+void LCD_display(int row, int col, const __FlashStringHelper *text) {
+    lcdPut_P(row, col, text);
+}
+
+void LCD_display(int row, int col, const char *text) {
+    lcdPut(row, col, text);
 }
 
 
@@ -668,7 +1095,7 @@ void setLNTurnout(int address, byte dir) {
 
 
 
-// Construct a Loconet packet that requests a turnout to set/change its state
+// Construct and queue a Loconet packet that requests a turnout to set/change its state
 void sendOPC_SW_REQ(int address, byte dir, byte on) {
 
 #if DEBUG_LVL > 1
@@ -676,30 +1103,28 @@ void sendOPC_SW_REQ(int address, byte dir, byte on) {
   debugln("--- sendOPC_SW_REQ:switch "+String(address)+", "+String(dir)+", "+String(on) );
 #endif
 
-  lnMsg SendPacket ;
-    
   int sw2 = 0x00;
   if (dir == STRAIGHT) { sw2 |= B00100000; }
   if (on) { sw2 |= B00010000; }
   sw2 |= (address >> 7) & 0x0F;
     
-  SendPacket.data[ 0 ] = OPC_SW_REQ ;
-  SendPacket.data[ 1 ] = address & 0x7F ;
-  SendPacket.data[ 2 ] = sw2 ;
-    
-  LocoNet.send( &SendPacket );
+  txQueue( TX_SWITCH, OPC_SW_REQ, address & 0x7F, sw2 );
+}
+
+
+// Construct and queue a Loconet packet that asks for the state of a turnout
+void sendOPC_SW_STATE(int address) {
+  txQueue( TX_SWITCH, OPC_SW_STATE, address & 0x7F, (address >> 7) & 0x0F );
 }
 
 
 // Set power status
 void sendOPC_GP(byte on) {
-        lnMsg SendPacket;
         if (on) {
-            SendPacket.data[ 0 ] = OPC_GPON;  
+            txQueue( TX_POWER, OPC_GPON, 0, 0 );
         } else {
-            SendPacket.data[ 0 ] = OPC_GPOFF;  
+            txQueue( TX_EMERGENCY, OPC_GPOFF, 0, 0 );
         }
-        LocoNet.send( &SendPacket ) ;
 }
 
 
@@ -715,8 +1140,8 @@ void notifyPower(uint8_t State) {
 
   State == POWERON ? digitalWrite(POWERLED, HIGH) : digitalWrite(POWERLED, LOW);
 
-  LCD_display(display, 3,10, "Power: ");
-  LCD_display(display, 3,17, State == POWERON ? "ON " : "OFF");
+  LCD_display(3, 10, F("Power: "));
+  LCD_field<3>(3, 17, State == POWERON ? F("ON") : F("OFF"));
 
 }
 
@@ -725,19 +1150,22 @@ void notifyPower(uint8_t State) {
 /* ------------------------------------------------------------------------- *
  *                                                     notifySwitchRequest()
  * These call-back functions are called from the routine
- * LocoNet.processSwitchSensorMessage for all Switch Request messages
+ * LocoNet.processSwitchSensorMessage for all Switch Request messages.
+ * Loconet hands every frame we send back to us, so a request only tells
+ * what was asked, by us or a throttle. Only the report of the command
+ * station tells where the switch is.
  * ------------------------------------------------------------------------- */
 void notifySwitchRequest( uint16_t Address, uint8_t Output, uint8_t State ) {
 #if DEBUG_LVL > 2
   debugln("--- notifySwitchRequest, "+String(Address)+", "+String(Output)+", "+String(State));
 #endif
-  handleSwitchRequest( Address, Output, State );  // Update element and control panel status
 }
 
 void notifySwitchReport( uint16_t Address, uint8_t Output, uint8_t Direction ) {
 #if DEBUG_LVL > 2
   debugln("--- notifySwitchReport, "+String(Address)+", "+String(Output)+", "+String(Direction));
 #endif
+  txReport(Address - 1);                    // Pace by the station's reports
   handleSwitchRequest( Address, Output, Direction );
 }
 
@@ -745,52 +1173,74 @@ void notifySwitchState( uint16_t Address, uint8_t Output, uint8_t Direction ) {
 #if DEBUG_LVL > 2
   debugln("--- notifySwitchState, "+String(Address)+", "+String(Output)+", "+String(Direction));
 #endif
-  handleSwitchRequest( Address, Output, Direction );
+                                            // OPC_SW_STATE is a query, the
+                                            //  answer is an OPC_LONG_ACK
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                           handleLongAck()
+ * The command station answers an OPC_SW_STATE query with an OPC_LONG_ACK,
+ * its ACK1 byte holding the switch direction in the same bit as SW2 of a
+ * switch request. Only the answer to our own outstanding query is used.
+ * ------------------------------------------------------------------------- */
+void handleLongAck(lnMsg *packet) {
+  if (packet->data[1] != (OPC_SW_STATE & 0x7F)) return;  // Not for a query
+  if (syncQuery == NOT_FOUND) return;       // Not asked by us
+
+  byte state = (packet->data[2] & B00100000) ? STRAIGHT : THROWN;
+  swReport(syncQuery, state);
+  confirmReceived(syncQuery, state);
+  mcpSwitchImage(syncQuery >> 4);
+
+#if DEBUG_LVL > 2
+  debugln("--- handleLongAck:Switch "+String(elemAddress(syncQuery))+" = "+String(packet->data[2]));
+#endif
+
+  syncQuery = NOT_FOUND;
+  syncWait  = 0;                            // Go on with the next query
 }
 
 
 
 /* ------------------------------------------------------------------------- *
  *                                                     HandleSwitchRequest()
- * This call-back function is called from LocoNet.processSwitchSensorMessage
- * for all Switch Request messages
+ * Called for the Switch Report messages of the command station
  * ------------------------------------------------------------------------- */
 void handleSwitchRequest( uint16_t Address, uint8_t Output, uint8_t state ) {
 #if DEBUG_LVL > 2
   debugln("handleSwitchRequest, "+String(Address)+", "+String(Output)+", "+String(state));
 #endif
 
-  int index;
-  for (index = 0; index < nElements; index++) { // Look up Switch address
-    if (element[index].address == Address) {
-      break;
-    }
-  }
+  int index = findSwitch(Address);          // Look up Switch address
 
-  if (element[index].type == TYPE_SWITCH && index < nElements) {
-                                            // Calculate mx address and port 
-    int mx = (index / 16) * 2;              //  for the even numbered mux
-    int port = (index % 16);                //  from switch position in elements
+  if (index != NOT_FOUND) {
+    swReport(index, state == 0 ? THROWN : STRAIGHT); // Known to the CS now
+    confirmReceived(index, state == 0 ? THROWN : STRAIGHT); // Stop retrying
 
-    int val = (state == 0 ? 0 : 1 );          // To set mux ports
-    mcps[mx].mcp.digitalWrite(port, val );    // Set first LED on or off
-    mcps[mx+1].mcp.digitalWrite(port, !val ); // Set second LED on or off
+    mcpSwitchImage(index >> 4);             // Set LEDs of this mux pair
+    ktReported(index);
 
 #if DEBUG_LVL > 1
-    debug("--- handleSwitchRequest:Set Switch "+String(element[index].address)+" to "+ String(state) );
+    int val = (state == 0 ? 0 : 1 );        // The mux ports
+    int mx = (index / 16) * 2;              // Calculated mx address and port 
+    int port = (index % 16);                //  for the even numbered mux
+    debug("--- handleSwitchRequest:Set Switch "+String(elemAddress(index))+" to "+ String(state) );
     debug(" - mx "+String(mx)+","+String(port)+" = "+String(val) );
     debug(", mx "+String(mx+1)+","+String(port)+" = "+ String(!val) );
     debug(" - ");
     debugln(Output ? "On" : "Off");
 #endif
 
-    LCD_display(display, 0, 0, F("Switch              "));
-    LCD_display(display, 0, 7, String(Address));
-    LCD_display(display, 0,12, state == STRAIGHT ? STATE_STRAIGHT : STATE_THROWN );
+    LCD_field<7>(0, 0, F("Switch"));
+    LCD_number<4>(0, 7, Address);
+    LCD_display(0, 11, F(" "));
+    LCD_display(0, 12, state == STRAIGHT ? STATE_STRAIGHT : STATE_THROWN );
 
   } else {
 
-    debug("--- handleSwitchRequest:Address " + String(element[index].address) + " :: ");
+    debug(F("--- handleSwitchRequest:Address ")); debug(Address); debug(F(" :: "));
     debugln("ERROR ERROR ERROR :: Address not found");
 
   }
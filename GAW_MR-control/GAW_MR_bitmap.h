@@ -0,0 +1,93 @@
+/* ------------------------------------------------------------------------- *
+ *                                                     Switch state bitmaps
+ * Switch states are also kept as bits, one bit per switch (1 = STRAIGHT),
+ * by their index in element[]. One 16 bit word covers 16 switches, just
+ * like one pair of MCP23017's, so LED images, the EEPROM image and the
+ * differences for the sync are computed a word at a time.
+ *   swValid    - switches in use (address > 0)
+ *   swWanted   - the state we want, same as element[].state
+ *   swKnown    - the command station told us the state
+ *   swReported - the state it told us
+ * element[].state and swWanted are changed together, via swWant().
+ * ------------------------------------------------------------------------- */
+#define SW_WORDS ((MAX_SWITCHES + 15) / 16) // Words per bitmap
+
+#define SW_ALL      0                       // Selections
+#define SW_UNKNOWN  1                       //  for
+#define SW_DIFF     2                       //   swNext()
+
+uint16_t swValid[SW_WORDS];
+uint16_t swWanted[SW_WORDS];
+uint16_t swKnown[SW_WORDS];
+uint16_t swReported[SW_WORDS];
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                        swGet(), swPut()
+ * ------------------------------------------------------------------------- */
+bool swGet(const uint16_t *map, int index) {
+  return map[index >> 4] & (1u << (index & 15));
+}
+
+void swPut(uint16_t *map, int index, bool on) {
+  if (on) {
+    map[index >> 4] |= (1u << (index & 15));
+  } else {
+    map[index >> 4] &= ~(1u << (index & 15));
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  swWant()
+ * Set the wanted state of a switch
+ * ------------------------------------------------------------------------- */
+void swWant(int index, byte state) {
+  element[index].state = state;
+  swPut(swWanted, index, state == STRAIGHT);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                swReport()
+ * The command station told us the state of a switch
+ * ------------------------------------------------------------------------- */
+void swReport(int index, byte state) {
+  swPut(swKnown, index, true);
+  swPut(swReported, index, state == STRAIGHT);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 csKnows()
+ * True when the command station has told us the switch is in this state
+ * ------------------------------------------------------------------------- */
+bool csKnows(int index, byte state) {
+  return swGet(swKnown, index) && swGet(swReported, index) == (state == STRAIGHT);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  swNext()
+ * Returns the first switch from index on that is in the selection, or
+ * NOT_FOUND. The selection is made per word:
+ *   SW_ALL     - all switches in use
+ *   SW_UNKNOWN - state not known to the command station
+ *   SW_DIFF    - unknown, or known but different from the wanted state
+ * ------------------------------------------------------------------------- */
+int swNext(int index, byte select) {
+  for (int w = index >> 4; w < SW_WORDS; w++) {
+    uint16_t bits = 0xFFFF;
+    if (select == SW_UNKNOWN) bits = ~swKnown[w];
+    if (select == SW_DIFF)    bits = ~swKnown[w] | (swWanted[w] ^ swReported[w]);
+    bits &= swValid[w];
+    if (w == (index >> 4)) bits &= 0xFFFFu << (index & 15);  // Skip before index
+
+    if (bits) {
+      int b = 0;
+      while (!(bits & 1)) { bits >>= 1; b++; }
+      return (w << 4) + b;
+    }
+  }
+  return NOT_FOUND;
+}
@@ -0,0 +1,138 @@
+/* ------------------------------------------------------------------------- *
+ *                                              Switch command confirmation
+ * Every switch request that is sent is remembered per switch until the
+ * command station reports the same state, in an OPC_SW_REP (see
+ * handleSwitchRequest()) or in the answer to a query (handleLongAck()).
+ * The echo of our own request does not count, Loconet returns that even
+ * when nobody listens. When no report arrives within confirmWait() ms
+ * the request is sent again, with the state wanted by then, at most
+ * CONFIRM_RETRIES times. From that first timeout on, the LEDs of the
+ * switch blink until it is confirmed, and keep blinking when all retries
+ * failed. A retry that is still waiting in the send queue is not timed
+ * out, its time only starts when it is sent (or dropped).
+ *
+ * This replaces sending every command twice, only lost commands are
+ * repeated now.
+ *
+ * The send queue measures the report times, for its pace, see txReport()
+ * in GAW_MR_txqueue.h. The wait follows that average, so a slow station
+ * does not get every request two more times.
+ * ------------------------------------------------------------------------- */
+#define CONFIRM_TIMEOUT  500                // ms to wait for a report,
+#define CONFIRM_RTT_TIMES  3                //  at least, or this times txRtt
+#define CONFIRM_RETRIES    2                // Sends after the first one
+#define CONFIRM_BLINK    250                // ms per LED blink phase
+#define CONFIRM_FAILED  0xFF                // No more retries
+
+void sendOPC_SW_REQ(int address, byte dir, byte on);  // In the sketch
+extern unsigned long txRtt;                 // In GAW_MR_txqueue.h
+
+byte cfTries[nSwitches];                    // Sends so far, 0 = confirmed
+byte cfState[nSwitches];                    // State waiting for a report
+unsigned long cfSent[nSwitches];            // millis() of the last send
+uint16_t cfQueued[SW_WORDS];                // Retry not sent yet
+byte cfPending = 0;                         // Switches with cfTries > 0
+
+unsigned long cfRetries  = 0;               // Statistics
+unsigned long cfFailures = 0;
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             confirmWait()
+ * ms to wait for the report of a switch request, CONFIRM_RTT_TIMES the
+ * average report time, but at least CONFIRM_TIMEOUT
+ * ------------------------------------------------------------------------- */
+unsigned long confirmWait() {
+  unsigned long wait = CONFIRM_RTT_TIMES * txRtt;
+  return wait > CONFIRM_TIMEOUT ? wait : CONFIRM_TIMEOUT;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                              confirmSent(), confirmUnsent()
+ * Called when a switch request has actually been sent on Loconet, or was
+ * dropped by the send queue (address as in the message, so one less than
+ * the switch address). A dropped request counts as one sent and lost, it
+ * is tried again after the wait.
+ * ------------------------------------------------------------------------- */
+void confirmSent(int address, byte dir) {
+  int index = findSwitch(address + 1);
+  if (index == NOT_FOUND) return;
+
+  swPut(cfQueued, index, false);
+
+  if (cfTries[index] == 0) {                // New request
+    cfPending++;
+    cfTries[index] = 1;
+  } else if (cfState[index] != dir || cfTries[index] == CONFIRM_FAILED) {
+    cfTries[index] = 1;                     // Other state, start over
+  }
+  cfState[index] = dir;
+  cfSent[index]  = millis();
+}
+
+void confirmUnsent(int address, byte dir) {
+  confirmSent(address, dir);                // Wait, then try again
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                         confirmReceived()
+ * Called for every report of a switch, returns true when it confirmed
+ * an outstanding request
+ * ------------------------------------------------------------------------- */
+bool confirmReceived(int index, byte state) {
+  if (cfTries[index] == 0 || cfState[index] != state) return false;
+
+  cfTries[index] = 0;
+  cfPending--;
+  return true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            confirmCheck()
+ * Called from loop(): retry switch requests without a report and blink
+ * the LEDs of switches that are overdue
+ * ------------------------------------------------------------------------- */
+void confirmCheck() {
+  if (!cfPending) return;                   // Quick exit
+
+  bool blinkOn = (millis() / CONFIRM_BLINK) & 1;
+  unsigned long wait = confirmWait();
+
+  for (int i = switchFirst; i <= switchLast; i++) {
+    if (cfTries[i] == 0) continue;
+    if (millis() - cfSent[i] < wait) continue;
+
+    if (cfTries[i] != CONFIRM_FAILED && !swGet(cfQueued, i)) {
+      if (cfTries[i] > CONFIRM_RETRIES) {   // Give up
+        cfTries[i] = CONFIRM_FAILED;
+        cfFailures++;
+        debug(F("--- confirmCheck:Switch ")); debug(elemAddress(i));
+        debugln(F(" not confirmed"));
+      } else {                              // Try again
+        cfTries[i]++;
+        cfRetries++;
+        cfSent[i] = millis();
+        swPut(cfQueued, i, true);           // Timed from its send
+        sendOPC_SW_REQ(elemAddress(i) - 1, element[i].state, 1);
+      }
+    }
+
+    int val = (element[i].state == 0 ? 0 : 1 ); // Blink wanted position
+    mcpSwitchLeds(i, blinkOn && val, blinkOn && !val);
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            confirmStats()
+ * Testing purposes: show the confirmation statistics
+ * ------------------------------------------------------------------------- */
+void confirmStats() {
+  debug(F("Switches unconfirmed: ")); debug(cfPending);
+  debug(F(", retries: ")); debug(cfRetries);
+  debug(F(", failed: ")); debug(cfFailures);
+  debug(F(", wait ms: ")); debugln(confirmWait());
+}
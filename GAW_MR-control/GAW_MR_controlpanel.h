@@ -3,17 +3,31 @@
  *       Define controlPanel variables
  *         this is the control panel for the model railroad layout
  *         The buttons are handled in a 8 x 8 grid
+ * Keycode 0 is NO_KEY for the Keypad library, buttons without an element
+ * use it. The map is also kept as a constexpr copy for the compiler, to
+ * check that every keycode points into the element array.
  * ------------------------------------------------------------------------ */
-char keys[ROWS][COLS] = {
-  { 1,  2,  3,  4,  5,  6,  7,  8},         // Return values for each
-  { 9, 10, 11, 12, 13, 14, 15, 16},         //  ROW/Column crossing
-  {17, 18, 19, 20, 21, 22, 23, 24},         //   are pointers into the 
-  {25, 26, 27, 28, 29, 30, 31, 32},         //    element array
-  {33, 34, 35, 36, 37, 38, 39, 40},
-  {41, 42, 43, 44, 45, 46, 47, 48},
-  {49, 50, 51, 52, 53, 54, 55, 56},
-  {57, 58, 59, 60, 61, 62, 63, 64}
-};
+#define KEY_MAP {                                                         \
+  { 1,  2,  3,  4,  5,  6,  7,  8},         /* Return values for each  */ \
+  { 9, 10, 11, 12, 13, 14, 15, 16},         /*  ROW/Column crossing    */ \
+  {17, 18, 19, 20, 21, 22, 23, 24},         /*   are pointers into the */ \
+  {25, 26, 27, 28, 29, 30, 31, 32},         /*    element array, + 1   */ \
+  {33, 34, 35, 36, 37, 38, 39, 40},                                       \
+  {41, 42, 43, 44, 45, 46, 47, 48},                                       \
+  {49, 50, 51, 52, 53,  0,  0,  0},         /* Spare buttons           */ \
+  { 0,  0,  0,  0,  0,  0,  0,  0}                                        \
+}
+
+char keys[ROWS][COLS] = KEY_MAP;
+constexpr char keyMap[ROWS][COLS] = KEY_MAP;
+
+constexpr bool keysValid(int k = 0) {       // All keycodes within element[]
+  return k >= ROWS * COLS ? true :
+         keyMap[k / COLS][k % COLS] >= 0 &&
+         keyMap[k / COLS][k % COLS] <= (int)nElements && keysValid(k + 1);
+}
+
+static_assert(keysValid(), "keycode beyond the element array");
 
 
 /* ------------------------------------------------------------------------- *
@@ -38,6 +52,6 @@ int activeLoc = 0;
 /* ------------------------------------------------------------------------- *
  *       Create objects with addres for the LCD screen
  * ------------------------------------------------------------------------- */
-LiquidCrystal_I2C display(0x27,20,4);       // Initialize display
+LiquidCrystal_I2C display(I2C_LCD_ADDRESS,20,4); // Initialize display
 
 
@@ -19,7 +19,8 @@
 
 #define TYPE_SWITCH    0                    // Types
 #define TYPE_LOCO      1                    //  for
-#define TYPE_FUNCTION 90                    //   element
+#define TYPE_ROUTE     2                    //   the
+#define TYPE_FUNCTION 90                    //    element
 #define TYPE_POWER    99                    //     array
 
 #define NO_MODULE   0                       // Module names
@@ -48,9 +49,28 @@
 
 #define FUNC_POWER     9999
 
+#define SYNC_IDLE      0                    // Phases for
+#define SYNC_QUERY     1                    //  synchronizing
+#define SYNC_SWITCHES  2                    //   state to
+#define SYNC_DONE      3                    //    the layout
+
+#define SYNC_DIFFERENTIAL 1                 // 1 = only send changed switches
+#define SYNC_QUERY_WAIT  100                // ms to wait for a state answer
+#define SYNC_HOLD       1000                // ms to show sync done
+
+#define MAX_SWITCHES  32                    // Switch LEDs on 2 mux pairs
+
+#define NOT_FOUND   -1                      // Index for unknown element
+
+#define NOTICE_TIME 1000                    // ms to show a status message
+
+#define SERIAL_LINE   16                    // Max length of serial command
+
 #define LN_TX_PIN 42                        // Loconet TX pin
 
 #define POWERLED  53                        // Panel Power indicator
 
 #define memSize EEPROM.length()             // Amount of EEPROM memory
+#define EE_SWITCHES 0                       // EEPROM: switch bitmap
+#define EE_ELEMENTS (SW_WORDS * 2)          //  followed by element states
 
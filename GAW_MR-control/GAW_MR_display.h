@@ -0,0 +1,282 @@
+/* ------------------------------------------------------------------------- *
+ *                                                          LCD frame buffer
+ * All output for the LCD goes into lcdBuf[], an in-memory copy of the
+ * screen. lcdFlush() compares it with lcdShown[], what is actually on the
+ * screen, and only sends the cells that changed. The cursor is only moved
+ * when the next changed cell does not directly follow the previous one.
+ *
+ * lcdFlush() is called from loop() with a time budget in microseconds.
+ * It stops as soon as the budget is used up and continues where it left
+ * off in the next pass, so loop() never waits long for the display.
+ * lcdHold() keeps what is on screen for a while (the initial screen),
+ * lcdBuf[] is still written and sent when the time is up.
+ *
+ * Every byte to the LCD costs LCD_I2C_PER_BYTE bytes on the I2C bus, as
+ * the PCF8574 backpack sends it in two nibbles, each with an enable pulse.
+ * LiquidCrystal_I2C sends every I2C byte in a transmission of its own:
+ *   write4bits()   - the nibble, then En high and low: 3 transmissions
+ *   command/write  - two write4bits(): 6 transmissions
+ *   init()         - backlight state 1, four write4bits() for the 4 bit
+ *                    mode 12, then function set, display on, clear,
+ *                    entry mode and home 5 * 6: 43 transmissions
+ *   backlight()    - 1 transmission
+ * That makes LCD_I2C_INIT 44 for init() plus backlight() in setup().
+ * ------------------------------------------------------------------------- */
+#define LCD_COLS 20                         // Size of
+#define LCD_ROWS  4                         //  the display
+#define LCD_I2C_PER_BYTE 6                  // I2C bytes per LCD byte
+#define LCD_I2C_INIT    44                  //  and for init, backlight
+#define LCD_BUDGET     400                  // us per loop() for the LCD
+#define LCD_NO_BUDGET    0                  // Flush all changes at once
+
+char lcdBuf[LCD_ROWS][LCD_COLS];            // What should be on screen
+char lcdShown[LCD_ROWS][LCD_COLS];          // What is on screen
+
+byte lcdCurRow = 0;                         // Where the LCD cursor is,
+byte lcdCurCol = LCD_COLS;                  //  LCD_COLS = unknown
+byte lcdScan = 0;                           // Next cell for lcdFlush()
+bool lcdDirty = false;                      // lcdBuf may differ from screen
+unsigned long lcdHeldSince = 0;             // millis() of lcdHold()
+unsigned long lcdHeldFor   = 0;             //  ms, 0 = not held
+
+unsigned long lcdCharsIn  = 0;              // Characters put in lcdBuf
+unsigned long lcdCharsOut = 0;              // Characters sent to the LCD
+unsigned long lcdMoves    = 0;              // Cursor moves sent to the LCD
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 lcdInit()
+ * The display is blank after display.init()
+ * ------------------------------------------------------------------------- */
+void lcdInit() {
+  memset(lcdBuf, ' ', sizeof(lcdBuf));
+  memset(lcdShown, ' ', sizeof(lcdShown));
+  lcdCurCol = LCD_COLS;
+  lcdDirty = false;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  lcdPut()
+ * Put text in the frame buffer, clipped at the end of the row
+ * ------------------------------------------------------------------------- */
+void lcdPut(int row, int col, const char *text) {
+  if (row < 0 || row >= LCD_ROWS) return;
+  while (*text && col < LCD_COLS) {
+    lcdBuf[row][col++] = *text++;
+    lcdCharsIn++;
+  }
+  lcdDirty = true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                lcdPut_P()
+ * Same as lcdPut(), for a text in flash memory (F() strings)
+ * ------------------------------------------------------------------------- */
+void lcdPut_P(int row, int col, const __FlashStringHelper *text) {
+  if (row < 0 || row >= LCD_ROWS) return;
+  const char *p = (const char *)text;
+  char c;
+  while ((c = pgm_read_byte(p++)) && col < LCD_COLS) {
+    lcdBuf[row][col++] = c;
+    lcdCharsIn++;
+  }
+  lcdDirty = true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                lcdBlank()
+ * Fill the frame buffer with spaces from col up to (not incl.) end
+ * ------------------------------------------------------------------------- */
+void lcdBlank(int row, int col, int end) {
+  if (row < 0 || row >= LCD_ROWS) return;
+  if (end > LCD_COLS) end = LCD_COLS;
+  while (col < end) {
+    lcdBuf[row][col++] = ' ';
+    lcdCharsIn++;
+  }
+  lcdDirty = true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                   LCD_field<W>(), LCD_number<W>()
+ * Fixed width fields, no String objects, no heap. The width W is a
+ * template parameter, so it is checked against the display at compile time.
+ *   LCD_field<W>  - text, left aligned, padded with spaces to W
+ *   LCD_number<W> - number, right aligned, padded with spaces to W
+ * ------------------------------------------------------------------------- */
+template <byte W> void LCD_field(int row, int col, const __FlashStringHelper *text) {
+  static_assert(W > 0 && W <= LCD_COLS, "field wider than the display");
+  int len = strlen_P((const char *)text);
+  lcdPut_P(row, col, text);
+  if (len < W) lcdBlank(row, col + len, col + W);
+}
+
+template <byte W> void LCD_field(int row, int col, const char *text) {
+  static_assert(W > 0 && W <= LCD_COLS, "field wider than the display");
+  int len = strlen(text);
+  lcdPut(row, col, text);
+  if (len < W) lcdBlank(row, col + len, col + W);
+}
+
+template <byte W> void LCD_number(int row, int col, long value, byte base = 10) {
+  static_assert(W > 0 && W <= LCD_COLS, "field wider than the display");
+  char digits[12];                          // Fits any long, with sign
+  ltoa(value, digits, base);
+  int len = strlen(digits);
+  if (len < W) lcdBlank(row, col, col + W - len);
+  lcdPut(row, col + (len < W ? W - len : 0), digits);
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     Timed status notices
+ * A notice is a text that disappears by itself after a while. lcdNotice()
+ * puts it in the frame buffer and remembers when it expires, lcdNotices()
+ * (called from loop()) blanks it again when its time is up. A notice that
+ * has been overwritten in the meantime is left alone.
+ * ------------------------------------------------------------------------- */
+#define NOTICE_SLOTS 6                      // Max notices at the same time
+
+struct NOTICE {
+  const __FlashStringHelper *text;          // NULL = free slot
+  byte row;
+  byte col;
+  unsigned long since;                      // Shown at
+  unsigned long time;                       //  for this many ms
+};
+
+NOTICE notices[NOTICE_SLOTS];
+byte nNotices = 0;                          // Active notices
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               lcdNotice()
+ * ------------------------------------------------------------------------- */
+void lcdNotice(int row, int col, const __FlashStringHelper *text, unsigned long ms) {
+  int slot = 0;
+  for (int i = 0; i < NOTICE_SLOTS; i++) {  // Same place, free slot or
+    if (notices[i].text && notices[i].row == row && notices[i].col == col) {
+      slot = i;                             //  else the one closest to
+      break;                                //  its expiry
+    }
+    if (!notices[i].text) {
+      slot = i;
+    } else if (notices[slot].text &&
+               notices[i].time - (millis() - notices[i].since) <
+               notices[slot].time - (millis() - notices[slot].since)) {
+      slot = i;
+    }
+  }
+
+  if (!notices[slot].text) nNotices++;
+  notices[slot].text  = text;
+  notices[slot].row   = row;
+  notices[slot].col   = col;
+  notices[slot].since = millis();
+  notices[slot].time  = ms;
+
+  lcdPut_P(row, col, text);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                              lcdNotices()
+ * Remove expired notices from the frame buffer
+ * ------------------------------------------------------------------------- */
+void lcdNotices() {
+  if (!nNotices) return;                    // Quick exit
+
+  for (int i = 0; i < NOTICE_SLOTS; i++) {
+    if (notices[i].text && millis() - notices[i].since >= notices[i].time) {
+      const char *p = (const char *)notices[i].text;
+      int len = strlen_P(p);
+      if (notices[i].col + len > LCD_COLS) len = LCD_COLS - notices[i].col;
+
+      if (memcmp_P(&lcdBuf[notices[i].row][notices[i].col], p, len) == 0) {
+        lcdBlank(notices[i].row, notices[i].col, notices[i].col + len);
+      }
+      notices[i].text = NULL;
+      nNotices--;
+    }
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 lcdHold()
+ * Send nothing to the display for ms milliseconds
+ * ------------------------------------------------------------------------- */
+void lcdHold(unsigned long ms) {
+  lcdHeldSince = millis();
+  lcdHeldFor   = ms;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                lcdFlush()
+ * Send changed cells to the display until the budget (in us) is used up.
+ * At least one cell is sent per call, LCD_NO_BUDGET sends all of them.
+ * Returns true when the screen is up to date.
+ * ------------------------------------------------------------------------- */
+bool lcdFlush(unsigned long budget) {
+  if (!lcdDirty) return true;               // Quick exit, nothing to do
+  if (lcdHeldFor) {                         // Initial screen still up
+    if (millis() - lcdHeldSince < lcdHeldFor) return false;
+    lcdHeldFor = 0;
+  }
+  I2C_CALLER(I2C_LCD);
+
+  unsigned long start = micros();
+  bool sent = false;
+
+  for (byte n = 0; n < LCD_ROWS * LCD_COLS; n++) {
+    byte row = lcdScan / LCD_COLS;
+    byte col = lcdScan % LCD_COLS;
+
+    if (lcdBuf[row][col] != lcdShown[row][col]) {
+      if (sent && budget != LCD_NO_BUDGET && micros() - start >= budget) {
+        return false;                       // Rest in the next pass
+      }
+      if (row != lcdCurRow || col != lcdCurCol) {
+        display.setCursor(col, row);
+        lcdMoves++;
+        i2cCount(I2C_LCD_ADDRESS, LCD_I2C_PER_BYTE, LCD_I2C_PER_BYTE);
+      }
+      LOOP_TAG(LT_DISPLAY);
+      display.write(lcdBuf[row][col]);
+      i2cCount(I2C_LCD_ADDRESS, LCD_I2C_PER_BYTE, LCD_I2C_PER_BYTE);
+      lcdShown[row][col] = lcdBuf[row][col];
+      lcdCharsOut++;
+      lcdCurRow = row;                      // Rows do not wrap to the next
+      lcdCurCol = col + 1;                  //  one, LCD_COLS forces a move
+      sent = true;
+    }
+
+    if (++lcdScan >= LCD_ROWS * LCD_COLS) lcdScan = 0;
+  }
+
+  lcdDirty = false;                         // Went round, all done
+  return true;
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                lcdStats()
+ * Testing purposes: show how much LCD traffic the frame buffer saved
+ * ------------------------------------------------------------------------- */
+void lcdStats() {
+  unsigned long sent  = lcdCharsOut + lcdMoves;
+  unsigned long saved = lcdCharsIn > sent ? lcdCharsIn - sent : 0;
+
+  debug(F("LCD chars in: ")); debug(lcdCharsIn);
+  debug(F(", sent: ")); debug(lcdCharsOut);
+  debug(F(", cursor moves: ")); debugln(lcdMoves);
+  debug(F("LCD I2C bytes saved: ")); debugln(saved * LCD_I2C_PER_BYTE);
+}
@@ -0,0 +1,100 @@
+/* ------------------------------------------------------------------------- *
+ *                                                    I2C traffic accounting
+ * The LCD (0x27) and the MCP23017's (0x20 - 0x26) share one I2C bus at
+ * 100 kHz. The libraries do not tell what they send, so we count what we
+ * ask of them, at the cost of each call on the bus:
+ *   LCD byte, character or command  - 6 transmissions of 1 byte
+ *   MCP23017 writeGPIOAB()          - 1 transmission of 3 bytes
+ * Transmissions and bytes (plus one address byte per transmission) are
+ * counted per device and per caller. The callers are where the bus is
+ * actually used: lcdFlush() for everything written with LCD_display()
+ * and friends, mcpFlush() for the LEDs set in handleSwitchRequest() and
+ * elsewhere, as those only change buffers. The outermost caller counts,
+ * so what lcdFlush() sends during setup() is counted for setup().
+ * Bus time is estimated at 9 clocks per byte plus start and stop.
+ * ------------------------------------------------------------------------- */
+#define I2C_CLOCK_US     10                 // us per clock at 100 kHz
+#define I2C_FIRST      0x20                 // Devices 0x20
+#define I2C_DEVICES       8                 //  up to 0x27
+#define I2C_LCD_ADDRESS 0x27                // LCD backpack
+
+#define I2C_OTHER         0                 // Callers
+#define I2C_SETUP         1
+#define I2C_LCD           2                 //  lcdFlush()
+#define I2C_LEDS          3                 //  mcpFlush()
+#define I2C_CALLERS       4
+
+struct I2CCOUNT {
+  unsigned long transmissions;
+  unsigned long bytes;                      // Including address bytes
+};
+
+I2CCOUNT i2cDevice[I2C_DEVICES];
+I2CCOUNT i2cCaller[I2C_CALLERS];
+byte i2cCurrent = I2C_OTHER;                // Who is using the bus
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               I2C_CALLER
+ * Marks the caller for the rest of the block, when no outer one did
+ * ------------------------------------------------------------------------- */
+struct I2CScope {
+  byte outer;
+  I2CScope(byte caller) : outer(i2cCurrent) {
+    if (outer == I2C_OTHER) i2cCurrent = caller;
+  }
+  ~I2CScope() { i2cCurrent = outer; }
+};
+
+#define I2C_CALLER(c) I2CScope i2cScope(c)
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                i2cCount()
+ * ------------------------------------------------------------------------- */
+void i2cCount(byte address, unsigned int transmissions, unsigned int data) {
+  unsigned long bytes = transmissions + data;
+
+  byte d = address - I2C_FIRST;
+  if (d < I2C_DEVICES) {
+    i2cDevice[d].transmissions += transmissions;
+    i2cDevice[d].bytes += bytes;
+  }
+  i2cCaller[i2cCurrent].transmissions += transmissions;
+  i2cCaller[i2cCurrent].bytes += bytes;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     i2cBusMs(), i2cStats()
+ * Testing purposes: where the bus time goes
+ * ------------------------------------------------------------------------- */
+unsigned long i2cBusMs(const I2CCOUNT &c) {
+  return (c.bytes * 9 + c.transmissions * 2) * I2C_CLOCK_US / 1000;
+}
+
+void i2cShow(const I2CCOUNT &c) {
+  debug(c.transmissions); debug(F(" / "));
+  debug(c.bytes); debug(F(" / "));
+  debugln(i2cBusMs(c));
+}
+
+void i2cStats() {
+  debugln(F("I2C transmissions / bytes / bus ms, per device:"));
+  for (byte d = 0; d < I2C_DEVICES; d++) {
+    if (i2cDevice[d].transmissions == 0) continue;
+    debug(F("  0x")); debugfmt(I2C_FIRST + d, HEX); debug(F(": "));
+    i2cShow(i2cDevice[d]);
+  }
+
+  debugln(F(" per caller:"));
+  for (byte c = 0; c < I2C_CALLERS; c++) {
+    switch (c) {
+      case I2C_SETUP: debug(F("  setup:    ")); break;
+      case I2C_LCD:   debug(F("  lcdFlush: ")); break;
+      case I2C_LEDS:  debug(F("  mcpFlush: ")); break;
+      default:        debug(F("  other:    ")); break;
+    }
+    i2cShow(i2cCaller[c]);
+  }
+}
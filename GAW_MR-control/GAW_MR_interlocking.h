@@ -0,0 +1,165 @@
+/* ------------------------------------------------------------------------- *
+ *                                                              Interlocking
+ * A route that has been set locks its switches: they can not be flipped
+ * by hand, and routes that need one of them in the other state are
+ * blocked, until the route is released by pressing its button again.
+ *
+ * The tables for this are computed by the compiler from routeSteps[] and
+ * stored in flash, one bit per route or switch:
+ *   routeConflicts[r] - the routes that conflict with route r+1
+ *   routeSwitches[r]  - the switches used by route r+1
+ * Checking a request is then a matter of AND-ing with routesSet or
+ * swLocked, instead of comparing routes at run time. Both are uint32_t,
+ * so there are at most 32 switches (LOCK_MAX) and routes.
+ *
+ * The locks are not stored in EEPROM. Recalling the state puts switches
+ * where they were stored, maybe out of a route, so it releases all routes
+ * (routeReleaseAll()).
+ * ------------------------------------------------------------------------- */
+#define ROUTE_MAX   8                       // Max routes, bits in a row
+#define LOCK_MAX   MAX_SWITCHES             // Max switch index + 1
+
+
+/* ------------------------------------------------------------------------- *
+ *                                   Compile time route helpers (C++11 style)
+ * ------------------------------------------------------------------------- */
+constexpr int nRouteSteps = sizeof(routeSteps) / sizeof(ROUTE_STEP);
+
+constexpr bool isRouteEnd(int step) {       // End of route or table
+  return step >= nRouteSteps || routeSteps[step].sw == ROUTE_END_SW;
+}
+
+constexpr int countRoutes(int step = 0) {   // Number of routes
+  return step >= nRouteSteps ? 0 : 
+         (routeSteps[step].sw == ROUTE_END_SW ? 1 : 0) + countRoutes(step + 1);
+}
+
+constexpr int routeEnd(int step) {          // ROUTE_END of route at step
+  return isRouteEnd(step) ? step : routeEnd(step + 1);
+}
+
+constexpr int routeStart(int route, int step = 0) {  // First step of route
+  return route <= 1 ? step : routeStart(route - 1, routeEnd(step) + 1);
+}
+
+constexpr int stepState(int step, int sw) { // State of sw in route, or -1
+  return isRouteEnd(step) ? -1 :
+         routeSteps[step].sw == sw ? routeSteps[step].state : stepState(step + 1, sw);
+}
+
+constexpr bool stepsConflict(int stepA, int startB) {
+  return isRouteEnd(stepA) ? false :
+         (stepState(startB, routeSteps[stepA].sw) >= 0 &&
+          stepState(startB, routeSteps[stepA].sw) != routeSteps[stepA].state) ||
+         stepsConflict(stepA + 1, startB);
+}
+
+constexpr int maxRouteSwitch(int step = 0) { // Highest switch index used
+  return step >= nRouteSteps ? 0 :
+         (routeSteps[step].sw != ROUTE_END_SW && routeSteps[step].sw > maxRouteSwitch(step + 1)) ?
+         routeSteps[step].sw : maxRouteSwitch(step + 1);
+}
+
+constexpr int nRoutes = countRoutes();
+
+constexpr bool routesConflict(int a, int b) {
+  return a <= nRoutes && b <= nRoutes && a != b &&
+         stepsConflict(routeStart(a), routeStart(b));
+}
+
+constexpr uint32_t conflictRow(int a, int b = 1) {
+  return b > ROUTE_MAX ? 0 :
+         (routesConflict(a, b) ? (1UL << (b - 1)) : 0) | conflictRow(a, b + 1);
+}
+
+constexpr uint32_t stepSwitches(int step) {
+  return isRouteEnd(step) ? 0 : (1UL << routeSteps[step].sw) | stepSwitches(step + 1);
+}
+
+constexpr uint32_t switchRow(int route) {
+  return route <= nRoutes ? stepSwitches(routeStart(route)) : 0;
+}
+
+constexpr bool stepsValid(int step = 0) {   // Steps use switches in use
+  return step >= nRouteSteps ? true :
+         (routeSteps[step].sw == ROUTE_END_SW ||
+          (routeSteps[step].sw <= switchLast &&
+           elementDef[routeSteps[step].sw].address > 0)) && stepsValid(step + 1);
+}
+
+constexpr bool routeElementsValid(int i = routeFirst) { // Routes defined
+  return i > routeLast ? true :
+         elementDef[i].address >= 1 && elementDef[i].address <= nRoutes &&
+         routeElementsValid(i + 1);
+}
+
+static_assert(LOCK_MAX <= 32 && ROUTE_MAX <= 32, "locks are kept in uint32_t masks");
+static_assert(nRoutes <= ROUTE_MAX, "too many routes, raise ROUTE_MAX");
+static_assert(maxRouteSwitch() < LOCK_MAX, "route switch index too high for interlocking");
+static_assert(stepsValid(), "routeSteps[] uses an index that is not a switch in use");
+static_assert(routeElementsValid(), "route element without steps in routeSteps[]");
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                         Tables in flash
+ * ------------------------------------------------------------------------- */
+const uint32_t routeConflicts[ROUTE_MAX] PROGMEM = {
+  conflictRow(1), conflictRow(2), conflictRow(3), conflictRow(4),
+  conflictRow(5), conflictRow(6), conflictRow(7), conflictRow(8),
+};
+
+const uint32_t routeSwitches[ROUTE_MAX] PROGMEM = {
+  switchRow(1), switchRow(2), switchRow(3), switchRow(4),
+  switchRow(5), switchRow(6), switchRow(7), switchRow(8),
+};
+
+static_assert(ROUTE_MAX == 8, "extend the tables above with ROUTE_MAX");
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                      Interlocking state
+ * ------------------------------------------------------------------------- */
+uint32_t routesSet = 0;                     // Routes that have been set
+uint32_t swLocked  = 0;                     // Switches locked by them
+
+
+/* ------------------------------------------------------------------------- *
+ *                                           routeIsSet(), routeBlocked()
+ * ------------------------------------------------------------------------- */
+bool routeIsSet(int route) {
+  return routesSet & (1UL << (route - 1));
+}
+
+bool routeBlocked(int route) {
+  return pgm_read_dword(&routeConflicts[route - 1]) & routesSet;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            switchLocked()
+ * ------------------------------------------------------------------------- */
+bool switchLocked(int index) {
+  return index < LOCK_MAX && (swLocked & (1UL << index));
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                              routeLock(), routeRelease(), routeReleaseAll()
+ * ------------------------------------------------------------------------- */
+void routeLock(int route) {
+  routesSet |= (1UL << (route - 1));
+  swLocked  |= pgm_read_dword(&routeSwitches[route - 1]);
+}
+
+void routeRelease(int route) {
+  routesSet &= ~(1UL << (route - 1));
+  swLocked = 0;                             // Rebuild from remaining routes
+  for (int r = 0; r < ROUTE_MAX; r++) {
+    if (routesSet & (1UL << r)) swLocked |= pgm_read_dword(&routeSwitches[r]);
+  }
+}
+
+void routeReleaseAll() {
+  routesSet = 0;
+  swLocked  = 0;
+}
@@ -0,0 +1,191 @@
+/* ------------------------------------------------------------------------- *
+ *                                                        Key press tracing
+ * What the operator feels is the time from pressing a button to the
+ * Loconet message leaving, and on to the LEDs showing the new state.
+ * Every key press gets a trace in a ring buffer of KT_TRACES, the oldest
+ * is overwritten. It holds the element and the micros() of the press, the
+ * moment controlPanel.getKey() returned it, plus the us after that of:
+ *   handled - handleKeys() returned, the messages are queued
+ *   sent    - txSend() sent the first message queued for the key
+ *   leds    - mcpFlush() wrote the LEDs after the command station
+ *             reported the switch, switches only. The echo of our own
+ *             request is no report, see notifySwitchRequest().
+ * A value of 0 means not (yet) seen: a coalesced or dropped message, or
+ * no report.
+ *
+ * Messages queued while a key is handled are marked in the send queue
+ * with the element (ktCurrent), so sent is found without searching.
+ * ktStats() shows the traces and the p50 / p99 per element type, serial
+ * command 'k'. The traces take some 430 bytes of SRAM, so they are only
+ * compiled in with KEY_TRACE 1 (GAW_debugging.h), off by default.
+ * ------------------------------------------------------------------------- */
+#define KT_TRACES      24                   // Traces kept
+#define KT_NONE      0xFF                   // No mux waiting
+
+#if KEY_TRACE && DEBUG_LVL > 0
+
+static_assert(nElements < KT_NONE, "element index does not fit a trace");
+
+struct KTRACE {
+  unsigned long at;                         // micros() of the key press
+  unsigned long handled;                    // us after it, 0 = not seen
+  unsigned long sent;
+  unsigned long leds;
+  byte index;                               // Element of the key
+  byte ledMux;                              // Mux to wait for, KT_NONE
+};
+
+KTRACE kt[KT_TRACES];
+byte ktNext  = 0;                           // Slot for the next trace
+byte ktCount = 0;                           // Traces in the buffer
+byte ktCurrent = 0;                         // Element + 1 being handled
+byte ktLedWait = 0;                         // Traces waiting for the LEDs
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 ktSince()
+ * us since the key press of a trace, at least 1 as 0 means not seen
+ * ------------------------------------------------------------------------- */
+unsigned long ktSince(const KTRACE *t) {
+  unsigned long us = micros() - t->at;
+  return us ? us : 1;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                      ktKey(), ktHandled()
+ * Around handleKeys(): start a trace, and note when the key is handled
+ * ------------------------------------------------------------------------- */
+void ktKey(int index) {
+  KTRACE *t = &kt[ktNext];
+  if (ktCount == KT_TRACES && t->ledMux != KT_NONE) ktLedWait--;
+
+  t->at = micros();
+  t->handled = t->sent = t->leds = 0;
+  t->index = index;
+  t->ledMux = KT_NONE;
+
+  ktNext = (ktNext + 1) % KT_TRACES;
+  if (ktCount < KT_TRACES) ktCount++;
+  ktCurrent = index + 1;
+}
+
+void ktHandled() {
+  KTRACE *t = &kt[(ktNext + KT_TRACES - 1) % KT_TRACES];
+  t->handled = ktSince(t);
+  ktCurrent = 0;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  ktFind()
+ * The newest trace of an element, NULL when there is none
+ * ------------------------------------------------------------------------- */
+KTRACE *ktFind(int index) {
+  for (byte n = 1; n <= ktCount; n++) {
+    KTRACE *t = &kt[(ktNext + KT_TRACES - n) % KT_TRACES];
+    if (t->index == index) return t;
+  }
+  return NULL;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                            ktSent(), ktReported(), ktLeds()
+ * ktSent() from txSend() with the mark of the message sent,
+ * ktReported() when a switch is reported, its LEDs are to be written,
+ * ktLeds() from mcpFlush() for every multiplexer written
+ * ------------------------------------------------------------------------- */
+void ktSent(byte mark) {
+  if (mark == 0) return;                    // Not queued for a key
+  KTRACE *t = ktFind(mark - 1);
+  if (t && t->sent == 0) t->sent = ktSince(t);
+}
+
+void ktReported(int index) {
+  KTRACE *t = ktFind(index);
+  if (!t || t->sent == 0 || t->leds != 0 || t->ledMux != KT_NONE) return;
+  t->ledMux = (index / 16) * 2;             // The even numbered mux
+  ktLedWait++;
+}
+
+void ktLeds(int mx) {
+  if (ktLedWait == 0) return;
+  for (byte n = 0; n < ktCount; n++) {     // Slots in use, from 0 on
+    if (kt[n].ledMux == (mx & ~1)) {        // Either mux of the pair
+      kt[n].leds = ktSince(&kt[n]);
+      kt[n].ledMux = KT_NONE;
+      ktLedWait--;
+    }
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 ktStats()
+ * Testing purposes: the traces, oldest first, and per element type the
+ * p50 / p99 (nearest rank) of each step
+ * ------------------------------------------------------------------------- */
+void ktPercentiles(byte type, unsigned long KTRACE::*step) {
+  unsigned long v[KT_TRACES];
+  byte n = 0;
+
+  for (byte i = 0; i < ktCount; i++) {      // Collect, insertion sorted
+    if (elemType(kt[i].index) != type || kt[i].*step == 0) continue;
+    byte j = n++;
+    for (; j > 0 && v[j - 1] > kt[i].*step; j--) v[j] = v[j - 1];
+    v[j] = kt[i].*step;
+  }
+
+  if (n == 0) {
+    debug(F("-"));
+    return;
+  }
+  debug(v[(n * 50 + 99) / 100 - 1]); debug(F(" / "));
+  debug(v[(n * 99 + 99) / 100 - 1]); debug(F(" ("));
+  debug(n); debug(F(")"));
+}
+
+void ktStats() {
+  debugln(F("Key traces, us after the key press: element, at ms, handled, sent, leds"));
+  for (byte n = ktCount; n > 0; n--) {
+    KTRACE *t = &kt[(ktNext + KT_TRACES - n) % KT_TRACES];
+    debug(F("  ")); debug(t->index);
+    debug(F(", ")); debug(t->at / 1000);
+    debug(F(", ")); debug(t->handled);
+    debug(F(", ")); debug(t->sent);
+    debug(F(", ")); debugln(t->leds);
+  }
+
+  debugln(F(" p50 / p99 (traces), per type:"));
+  const byte types[] = { TYPE_SWITCH, TYPE_LOCO, TYPE_ROUTE, TYPE_FUNCTION, TYPE_POWER };
+  for (byte n = 0; n < sizeof(types); n++) {
+    switch (types[n]) {
+      case TYPE_SWITCH:   debug(F("  switch:   handled ")); break;
+      case TYPE_LOCO:     debug(F("  loco:     handled ")); break;
+      case TYPE_ROUTE:    debug(F("  route:    handled ")); break;
+      case TYPE_FUNCTION: debug(F("  function: handled ")); break;
+      case TYPE_POWER:    debug(F("  power:    handled ")); break;
+    }
+    ktPercentiles(types[n], &KTRACE::handled);
+    debug(F(", sent "));
+    ktPercentiles(types[n], &KTRACE::sent);
+    debug(F(", leds "));
+    ktPercentiles(types[n], &KTRACE::leds);
+    debugln();
+  }
+}
+
+#else
+
+#define ktKey(index)
+#define ktHandled()
+#define ktSent(mark)
+#define ktReported(index)
+#define ktLeds(mx)
+
+void ktStats() {
+  debugln(F("Key tracing not compiled in, see KEY_TRACE"));
+}
+
+#endif
@@ -9,35 +9,47 @@
 /* ------------------------------------------------------------------------- *
  *                                               Size and number of elements
  * ------------------------------------------------------------------------- */
-#define entrySize sizeof(MR_data)               // Dynamic definitions for
-#define nElements sizeof(element) / entrySize   //  element size
+#define nElements (sizeof(elementDef) / sizeof(MR_data)) // Number of elements
+#define entrySize sizeof(MR_state)              // Size of state per element
 
 
 /* ------------------------------------------------------------------------- *
  *                                                         Element structure
- * The MR_date structure defines the variables per element.
+ * The MR_data structure defines the variables per element. The table of
+ * them never changes, so it lives in flash (elementDef[]). The states,
+ * which do change, are copied into the MR_state array element[] in SRAM
+ * at startup. Both are accessed by the same index.
  * ------------------------------------------------------------------------- */
 struct MR_data{                             // single element definition
-  int           type;      // switch, loco, function, power
-  int           module;    // modules on my layout (for switches)
+  uint8_t       type;      // switch, loco, route, function, power
+  uint8_t       module;    // modules on my layout (for switches)
   uint16_t      address;   // Loconet address where applicable
-  byte          state;     // depends on type
-  int           state2;    // depends on type
+  uint8_t       state;     // initial state, depends on type
+  uint8_t       state2;    // initial state, depends on type
 };
 
+struct MR_state{                            // single element state
+  uint8_t       state;     // depends on type
+  uint8_t       state2;    // depends on type
+};
+
+static_assert(sizeof(MR_data)  == 6, "MR_data must stay packed");
+static_assert(sizeof(MR_state) == 2, "MR_state must stay packed");
+
 
 /* ------------------------------------------------------------------------- *
  *                                                             Element array
- * The element[] array holds values for elements on the control panel.
- * At thispoint these are Switches, Locomotives, Functions and Power. 
+ * The elementDef[] array holds values for elements on the control panel.
+ * At thispoint these are Switches, Locomotives, Functions, Power and Routes.
  * ------------------------------------------------------------------------- */
-struct MR_data element[] = {
+constexpr MR_data elementDef[] PROGMEM = {
 
 
 // ===== CAVEAT ===== CAVEAT ===== CAVEAT ===== CAVEAT =====
 // Switches MUST come first in this array, as calculations for the 
 // LED multiplexers are based on the index of the switches in the 
-// element array
+// element array. Elements of one type must be kept together.
+// Both are checked by the compiler, see below.
 // ===== CAVEAT ===== CAVEAT ===== CAVEAT ===== CAVEAT =====
 
 
@@ -149,6 +161,144 @@ struct MR_data element[] = {
 //              POWER
   TYPE_POWER,    NO_MODULE, FUNC_POWER, POWERON, 0,
 
-};                                          // END OF element[] ARRAY
+/* ------------------------------------------------------------------------- *
+ * Type = 2, Routes:
+ *   module  = arbitrary, not used
+ *   address = Route number, see routeSteps[] below
+ *   state   = not used
+ *   state2  = not used
+ * Routes come last, so the keys of the other elements stay the same
+ * ------------------------------------------------------------------------- */
+
+//              Routes
+  TYPE_ROUTE,    NO_MODULE, 1, 0, 0,                // Module 4, track A
+  TYPE_ROUTE,    NO_MODULE, 2, 0, 0,                // Module 4, track B
+  TYPE_ROUTE,    NO_MODULE, 3, 0, 0,                // Module 8, main line
+
+};                                          // END OF elementDef[] ARRAY
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                              Compile time element checks
+ * The compiler checks elementDef[] and computes the index range of every
+ * type, so code can loop over the slice it needs instead of all elements.
+ * A type that is not in the table gets the empty range 0..-1.
+ * ------------------------------------------------------------------------- */
+constexpr int lastOfType(int type, int i = nElements - 1) {
+  return i < 0 ? -1 :
+         elementDef[i].type == type ? i : lastOfType(type, i - 1);
+}
+
+constexpr int firstOfType(int type, int i = 0) {
+  return i >= (int)nElements ? 0 :
+         elementDef[i].type == type ? i : firstOfType(type, i + 1);
+}
+
+constexpr int countOfType(int type, int i = 0) {
+  return i >= (int)nElements ? 0 :
+         (elementDef[i].type == type ? 1 : 0) + countOfType(type, i + 1);
+}
+
+constexpr bool typeTogether(int type) {     // No other types in between
+  return lastOfType(type) - firstOfType(type) + 1 == countOfType(type);
+}
+
+constexpr int switchFirst   = firstOfType(TYPE_SWITCH);
+constexpr int switchLast    = lastOfType(TYPE_SWITCH);
+constexpr int locoFirst     = firstOfType(TYPE_LOCO);
+constexpr int locoLast      = lastOfType(TYPE_LOCO);
+constexpr int functionFirst = firstOfType(TYPE_FUNCTION);
+constexpr int functionLast  = lastOfType(TYPE_FUNCTION);
+constexpr int powerFirst    = firstOfType(TYPE_POWER);
+constexpr int powerLast     = lastOfType(TYPE_POWER);
+constexpr int routeFirst    = firstOfType(TYPE_ROUTE);
+constexpr int routeLast     = lastOfType(TYPE_ROUTE);
+constexpr int nSwitches     = switchLast + 1; // Switch slots, incl. spare
+
+static_assert(countOfType(TYPE_SWITCH) > 0 && switchFirst == 0,
+              "switches MUST come first in elementDef[]");
+static_assert(typeTogether(TYPE_SWITCH) && typeTogether(TYPE_LOCO) &&
+              typeTogether(TYPE_FUNCTION) && typeTogether(TYPE_POWER) &&
+              typeTogether(TYPE_ROUTE), "keep elements of one type together");
+static_assert(countOfType(TYPE_SWITCH) + countOfType(TYPE_LOCO) +
+              countOfType(TYPE_FUNCTION) + countOfType(TYPE_POWER) +
+              countOfType(TYPE_ROUTE) == nElements, "unknown element type");
+static_assert(nSwitches <= MAX_SWITCHES, "too many switches, raise MAX_SWITCHES");
+static_assert(nElements < 256, "element indexes are stored in a byte");
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                       Element state array
+ * ------------------------------------------------------------------------- */
+MR_state element[nElements];
+
+
+/* ------------------------------------------------------------------------- *
+ *                             elemType(), elemModule(), elemAddress()
+ * Read the element definitions from flash
+ * ------------------------------------------------------------------------- */
+int elemType(int index) {
+  return pgm_read_byte(&elementDef[index].type);
+}
+
+int elemModule(int index) {
+  return pgm_read_byte(&elementDef[index].module);
+}
+
+uint16_t elemAddress(int index) {
+  return pgm_read_word(&elementDef[index].address);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          elementDefaults()
+ * Initial states of all elements, from their definitions
+ * ------------------------------------------------------------------------- */
+void elementDefaults() {
+  for (int i = 0; i < (int)nElements; i++) {
+    element[i].state  = pgm_read_byte(&elementDef[i].state);
+    element[i].state2 = pgm_read_byte(&elementDef[i].state2);
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                         Route definitions
+ * A route is a list of switches, by their index in element[], with the
+ * state they need for the route. Routes are numbered from 1 in the order
+ * below, each one ends with ROUTE_END.
+ * The interlocking tables are computed from this list by the compiler,
+ * see GAW_MR_interlocking.h, hence the constexpr.
+ * ------------------------------------------------------------------------- */
+#define ROUTE_END_SW  0xFF                  // Marks end of route
+#define ROUTE_END     { ROUTE_END_SW, 0 }
+
+struct ROUTE_STEP {
+  byte sw;                                  // Switch index in element[]
+  byte state;                               // STRAIGHT or THROWN
+};
+
+constexpr ROUTE_STEP routeSteps[] PROGMEM = {
+
+//              Route 1: module 4, track A
+  {  7, THROWN   },                                 // 401
+  {  8, STRAIGHT },                                 // 402
+  {  9, THROWN   },                                 // 403
+  ROUTE_END,
+
+//              Route 2: module 4, track B
+  {  7, THROWN   },                                 // 401
+  {  8, THROWN   },                                 // 402
+  { 10, STRAIGHT },                                 // 404
+  ROUTE_END,
+
+//              Route 3: module 8, main line
+  { 20, STRAIGHT },                                 // 801
+  { 21, STRAIGHT },                                 // 802
+  ROUTE_END,
+
+};
 
 
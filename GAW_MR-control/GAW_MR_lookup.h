@@ -0,0 +1,77 @@
+/* ------------------------------------------------------------------------- *
+ *                                                      Switch address index
+ * swIndex[] holds the indexes of all switches in the element[] array,
+ * sorted by their Loconet address. This way findSwitch() can do a binary
+ * search instead of scanning element[] for every incoming switch message.
+ *
+ * The index is built from the element definitions by buildSwitchIndex()
+ * at startup.
+ * Spare switches (address 0) are left out of the index. Switches beyond
+ * MAX_SWITCHES, without LEDs, can not occur: the compiler checks that in
+ * GAW_MR_layout.h.
+ * It also sets up the swValid and swWanted bitmaps from element[].
+ * The linear scan of the old days is kept for the host benchmark.
+ * ------------------------------------------------------------------------- */
+byte swIndex[nSwitches];                    // Sorted switch indexes
+int  nSwIndex = 0;                          // Number of entries in swIndex
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                        buildSwitchIndex()
+ * Insertion sort, keeps the table order for duplicate addresses, so the
+ * first switch in element[] wins, just like the old linear scan did.
+ * ------------------------------------------------------------------------- */
+void buildSwitchIndex() {
+  nSwIndex = 0;
+  memset(swValid, 0, sizeof(swValid));
+  for (int i = switchFirst; i <= switchLast; i++) {
+    if (elemAddress(i) > 0) {
+      swPut(swValid, i, true);
+      swWant(i, element[i].state);
+      int j = nSwIndex++;
+      while (j > 0 && elemAddress(swIndex[j-1]) > elemAddress(i)) {
+        swIndex[j] = swIndex[j-1];
+        j--;
+      }
+      swIndex[j] = i;
+    }
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                              findSwitch()
+ * Returns the element index for a switch address, or NOT_FOUND
+ * ------------------------------------------------------------------------- */
+int findSwitch(uint16_t address) {
+  int lo = 0;
+  int hi = nSwIndex;
+  while (lo < hi) {                         // Find first entry >= address
+    int mid = (lo + hi) >> 1;
+    if (elemAddress(swIndex[mid]) < address) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < nSwIndex && elemAddress(swIndex[lo]) == address) {
+    return swIndex[lo];
+  }
+  return NOT_FOUND;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                        linearFindSwitch()
+ * The old linear scan of element[], for the host benchmark that compares
+ * it with findSwitch() (host/bench.cpp). Unused in the sketch, so the
+ * linker leaves it out.
+ * ------------------------------------------------------------------------- */
+int linearFindSwitch(uint16_t address) {
+  for (int i = 0; i < (int)nElements; i++) {
+    if (elemType(i) == TYPE_SWITCH && elemAddress(i) == address) {
+      return i;
+    }
+  }
+  return NOT_FOUND;
+}
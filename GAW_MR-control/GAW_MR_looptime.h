@@ -0,0 +1,148 @@
+/* ------------------------------------------------------------------------- *
+ *                                                       loop() timing
+ * The time of every loop() pass, from one start to the next, is counted
+ * in a histogram with doubling buckets: bucket 0 below 2 us, bucket 1
+ * from 2 us, bucket 2 from 4 us, ... the last one from 8 ms on.
+ *
+ * Handlers that actually did something in a pass tag it with LOOP_TAG().
+ * Besides the histogram of all passes there is one per tag, holding the
+ * passes in which that handler ran, and one for the idle passes. The
+ * longest pass is kept with its tags and time, the spike to look for.
+ *
+ * Per pass this costs one micros() and the bucket count, LOOP_TAG() is a
+ * single OR, but the histograms take some 480 bytes of SRAM. So it is only
+ * compiled in with LOOP_PROFILE 1 (GAW_debugging.h), off by default.
+ * loopStats() prints and restarts the counts, serial command 'l'.
+ * ------------------------------------------------------------------------- */
+#define LT_LOCONET   0x01                   // Tags: Loconet message in
+#define LT_KEYS      0x02                   //  key pressed
+#define LT_SERIAL    0x04                   //  serial input
+#define LT_TX        0x08                   //  Loconet message out
+#define LT_LEDS      0x10                   //  LEDs written
+#define LT_DISPLAY   0x20                   //  display written
+#define LT_TAGS         6
+
+#define LT_ALL     LT_TAGS                  // Histogram rows after the
+#define LT_IDLE    (LT_TAGS + 1)            //  ones per tag
+#define LT_ROWS    (LT_TAGS + 2)
+#define LT_BUCKETS     14                   // Last from 2^13 us = 8 ms
+
+#if LOOP_PROFILE && DEBUG_LVL > 0
+
+#define LOOP_BEGIN() loopBegin()
+#define LOOP_TAG(t)  (loopTags |= (t))
+
+byte loopTags = 0;                          // Tags of the current pass
+unsigned long loopStart = 0;                // micros() at its start
+unsigned long loopHist[LT_ROWS][LT_BUCKETS];
+unsigned long loopMax[LT_ROWS];
+unsigned long loopWorstAt = 0;              // millis() of the longest pass
+byte          loopWorstTags = 0;
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             loopCount()
+ * ------------------------------------------------------------------------- */
+void loopCount(byte row, byte bucket, unsigned long us) {
+  loopHist[row][bucket]++;
+  if (us > loopMax[row]) loopMax[row] = us;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             loopBegin()
+ * Called first thing in loop(): count the pass that just ended
+ * ------------------------------------------------------------------------- */
+void loopBegin() {
+  unsigned long now = micros();
+
+  if (loopStart != 0) {
+    unsigned long us = now - loopStart;
+
+    byte bucket = 0;
+    for (unsigned long d = us; d > 1 && bucket < LT_BUCKETS - 1; d >>= 1) {
+      bucket++;
+    }
+
+    if (us > loopMax[LT_ALL]) {
+      loopWorstAt = millis();
+      loopWorstTags = loopTags;
+    }
+    loopCount(LT_ALL, bucket, us);
+
+    if (loopTags == 0) {
+      loopCount(LT_IDLE, bucket, us);
+    } else {
+      for (byte t = 0; t < LT_TAGS; t++) {
+        if (loopTags & (1 << t)) loopCount(t, bucket, us);
+      }
+    }
+  }
+
+  loopTags = 0;
+  loopStart = now;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             loopStats()
+ * Per row: passes, the buckets p50 and p99 end in, max and the histogram
+ * ------------------------------------------------------------------------- */
+unsigned long loopPercentile(byte row, unsigned long passes, byte pct) {
+  unsigned long want = (passes * pct + 99) / 100;
+  unsigned long seen = 0;
+  for (byte b = 0; b < LT_BUCKETS; b++) {
+    seen += loopHist[row][b];
+    if (seen >= want) return 2UL << b;      // Upper end of the bucket
+  }
+  return 2UL << (LT_BUCKETS - 1);
+}
+
+void loopStats() {
+  debugln(F("loop() us: passes, p50 <, p99 <, max | buckets from 0, 2, 4 .. 8192 us"));
+
+  for (byte row = 0; row < LT_ROWS; row++) {
+    unsigned long passes = 0;
+    for (byte b = 0; b < LT_BUCKETS; b++) passes += loopHist[row][b];
+    if (passes == 0 && row != LT_ALL) continue;
+
+    switch (row) {
+      case LT_ALL:  debug(F("  all      ")); break;
+      case LT_IDLE: debug(F("  idle     ")); break;
+      case 0:       debug(F("  loconet  ")); break;
+      case 1:       debug(F("  keys     ")); break;
+      case 2:       debug(F("  serial   ")); break;
+      case 3:       debug(F("  tx       ")); break;
+      case 4:       debug(F("  leds     ")); break;
+      case 5:       debug(F("  display  ")); break;
+    }
+    debug(passes);
+    debug(F(", ")); debug(loopPercentile(row, passes, 50));
+    debug(F(", ")); debug(loopPercentile(row, passes, 99));
+    debug(F(", ")); debug(loopMax[row]);
+    debug(F(" |"));
+    for (byte b = 0; b < LT_BUCKETS; b++) {
+      debug(' '); debug(loopHist[row][b]);
+    }
+    debugln();
+  }
+
+  debug(F("  longest at ")); debug(loopWorstAt);
+  debug(F(" ms, tags 0x")); debugfmt(loopWorstTags, HEX);
+  debugln();
+
+  memset(loopHist, 0, sizeof(loopHist));    // Start over
+  memset(loopMax, 0, sizeof(loopMax));
+  loopStart = 0;                            // Skip this (long) pass
+}
+
+#else
+
+#define LOOP_BEGIN()
+#define LOOP_TAG(t)
+
+void loopStats() {
+  debugln(F("loop() timing not compiled in, see LOOP_PROFILE"));
+}
+
+#endif
@@ -0,0 +1,46 @@
+/* ------------------------------------------------------------------------- *
+ *                                                        SRAM usage report
+ * At startup memPaint() fills all free SRAM between the heap and the
+ * stack with MEM_PAINT. memReport() shows how much of it was never
+ * touched since, the low water mark of free memory, plus the current
+ * size of the heap. Only available on AVR, the report says so elsewhere.
+ * ------------------------------------------------------------------------- */
+#define MEM_PAINT 0xA5                      // Pattern for untouched SRAM
+
+#ifdef __AVR__
+extern uint8_t __heap_start;                // Provided by the linker
+extern uint8_t *__brkval;                   // Current end of the heap
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                memPaint()
+ * Runs before main(), after the stack pointer has been set up
+ * ------------------------------------------------------------------------- */
+void memPaint() __attribute__ ((naked, used, section (".init3")));
+void memPaint() {
+  uint8_t *p = &__heap_start;
+  while (p < (uint8_t *)SP) {
+    *p++ = MEM_PAINT;
+  }
+}
+#endif
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               memReport()
+ * ------------------------------------------------------------------------- */
+void memReport() {
+#ifdef __AVR__
+  uint8_t *heapEnd = __brkval ? __brkval : &__heap_start;
+  uint8_t *p = heapEnd;
+  while (p < (uint8_t *)SP && *p == MEM_PAINT) {
+    p++;                                    // Never touched by the stack
+  }
+
+  debug(F("SRAM heap used: ")); debug((int)(heapEnd - &__heap_start));
+  debug(F(", free now: ")); debug((int)((uint8_t *)SP - heapEnd));
+  debug(F(", free low water: ")); debugln((int)(p - heapEnd));
+#else
+  debugln(F("SRAM report only available on AVR"));
+#endif
+}
@@ -17,25 +17,150 @@
  *
  * The multiplexer MCP23017's are addressed from 0x20 to max 0x27.
  * Their definitions are stored in the mcps[] array, see below.
+ *
+ * Output ports are not written directly, but in a shadow copy (gpio) of
+ * both GPIO registers. mcpFlush() writes the shadow of every changed
+ * expander in one I2C transaction, instead of a read-modify-write per pin.
+ * The switch LEDs of a pair are set a whole word at a time from the
+ * switch bitmaps by mcpSwitchImage().
  * ------------------------------------------------------------------------- */
 
 #define numberOfMx sizeof(mcps) / \
                   sizeof(MCPINFO)           // Number of expander interfaces
 
+#define MCP_IODIRA  0x00                    // First register (IOCON.BANK=0)
+#define MCP_GPIOA   0x12                    // GPIO registers
+#define MCP_NREGS   0x16                    // IODIRA up to and incl. OLATB
+
 struct MCPINFO {
   Adafruit_MCP23X17 mcp;
   uint8_t address;  
+  uint16_t gpio;                            // Shadow of GPIOB:GPIOA
+  bool dirty;                               // Shadow differs from chip
+  bool present;                             // Answered at initialization
 };
 
-MCPINFO mcps[] {
-  {Adafruit_MCP23X17(), 0x20},              // multiplexer 0
-  {Adafruit_MCP23X17(), 0x21},              // multiplexer 1
-  {Adafruit_MCP23X17(), 0x22},              // multiplexer 2
-  {Adafruit_MCP23X17(), 0x23},              // multiplexer 3
-  {Adafruit_MCP23X17(), 0x24},              // multiplexer 4
-  {Adafruit_MCP23X17(), 0x25},              // multiplexer 5
-  {Adafruit_MCP23X17(), 0x26},              // multiplexer 6
-//  {Adafruit_MCP23X17(), 0x27},              // multiplexer 7 (is also the address of the LCD display)
+MCPINFO mcps[] {                            // address, gpio, dirty, present
+  {Adafruit_MCP23X17(), 0x20, 0, false, false}, // multiplexer 0
+  {Adafruit_MCP23X17(), 0x21, 0, false, false}, // multiplexer 1
+  {Adafruit_MCP23X17(), 0x22, 0, false, false}, // multiplexer 2
+  {Adafruit_MCP23X17(), 0x23, 0, false, false}, // multiplexer 3
+  {Adafruit_MCP23X17(), 0x24, 0, false, false}, // multiplexer 4
+  {Adafruit_MCP23X17(), 0x25, 0, false, false}, // multiplexer 5
+  {Adafruit_MCP23X17(), 0x26, 0, false, false}, // multiplexer 6
+//  {Adafruit_MCP23X17(), 0x27, 0, false, false}, // multiplexer 7 (is also the address of the LCD display)
 };
 
+static_assert(2 * ((nSwitches + 15) / 16) <= numberOfMx,
+              "not enough multiplexer pairs for the switch LEDs");
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 mcpInit()
+ * Initialize an expander with all ports as output, in one I2C burst.
+ * With sequential addressing all registers from IODIRA up to OLATB are
+ * written in one go: IODIR all outputs, GPIO / OLAT from the shadow and
+ * the rest at their power-on defaults (the INTF/INTCAP ones are read only).
+ * Returns false when the expander does not answer.
+ * ------------------------------------------------------------------------- */
+bool mcpInit(int mx) {
+  mcps[mx].present = mcps[mx].mcp.begin_I2C(mcps[mx].address);
+  i2cCount(mcps[mx].address, 1, 0);         // Probe, address only
+  if (!mcps[mx].present) return false;
+
+  Wire.beginTransmission(mcps[mx].address);
+  Wire.write(MCP_IODIRA);                   // Start register
+  for (int reg = MCP_IODIRA; reg < MCP_NREGS; reg++) {
+    if (reg >= MCP_GPIOA) {                 // GPIO and OLAT, A then B
+      Wire.write(reg & 1 ? highByte(mcps[mx].gpio) : lowByte(mcps[mx].gpio));
+    } else {
+      Wire.write(0x00);                     // Outputs, defaults
+    }
+  }
+  mcps[mx].present = (Wire.endTransmission() == 0);
+  i2cCount(mcps[mx].address, 1, 1 + MCP_NREGS);
+  mcps[mx].dirty = false;
+
+  return mcps[mx].present;
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                mcpWrite()
+ * Set a port (0-15) in the shadow register of an expander
+ * ------------------------------------------------------------------------- */
+void mcpWrite(int mx, uint8_t port, uint8_t val) {
+  uint16_t gpio = mcps[mx].gpio;
+  if (val) {
+    gpio |= (1u << port);
+  } else {
+    gpio &= ~(1u << port);
+  }
+  if (gpio != mcps[mx].gpio) {
+    mcps[mx].gpio = gpio;
+    mcps[mx].dirty = true;
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               mcpSetAll()
+ * Set all 16 ports in the shadow register of an expander
+ * ------------------------------------------------------------------------- */
+void mcpSetAll(int mx, uint16_t gpio) {
+  if (gpio != mcps[mx].gpio) {
+    mcps[mx].gpio = gpio;
+    mcps[mx].dirty = true;
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          mcpSwitchImage()
+ * Set the LEDs of 16 switches (one bitmap word) from the states reported
+ * by the command station, the first mux for STRAIGHT, the second for
+ * THROWN. Unused and unknown switches have both LEDs off.
+ * ------------------------------------------------------------------------- */
+void mcpSwitchImage(int w) {
+  uint16_t shown = swValid[w] & swKnown[w];
+  mcpSetAll(w * 2,     swReported[w] & shown);
+  mcpSetAll(w * 2 + 1, ~swReported[w] & shown);
+}
+
+
 
+/* ------------------------------------------------------------------------- *
+ *                                                           mcpSwitchLeds()
+ * Set both LEDs of the switch at index in element[], the multiplexer pair
+ * and port follow from the index of the switch
+ * ------------------------------------------------------------------------- */
+void mcpSwitchLeds(int index, uint8_t first, uint8_t second) {
+  int mx = (index / 16) * 2;                // The even numbered mux
+  int port = (index % 16);
+
+  mcpWrite(mx,   port, first );             // Set first LED on or off
+  mcpWrite(mx+1, port, second );            // Set second LED on or off
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                mcpFlush()
+ * Write the shadow registers of all changed expanders, both ports at once
+ * ------------------------------------------------------------------------- */
+void mcpFlush() {
+  I2C_CALLER(I2C_LEDS);
+  for (size_t mx=0; mx<numberOfMx; mx++) {
+    if (mcps[mx].dirty && mcps[mx].present) {
+      LOOP_TAG(LT_LEDS);
+      mcps[mx].mcp.writeGPIOAB(mcps[mx].gpio);
+      i2cCount(mcps[mx].address, 1, 3);     // Register, GPIOA, GPIOB
+      ktLeds(mx);
+      mcps[mx].dirty = false;
+    }
+  }
+}
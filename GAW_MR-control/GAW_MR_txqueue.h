@@ -0,0 +1,399 @@
+/* ------------------------------------------------------------------------- *
+ *                                                      Loconet send queue
+ * Loconet messages are not sent right away, but queued by txQueue() and
+ * sent by txSend(), called from loop(), one message per pass. This way a
+ * busy Loconet (collisions, backoff) never holds up the keypad.
+ *
+ * There is a ring buffer per priority class, the highest priority message
+ * goes first:
+ *   TX_EMERGENCY - power off
+ *   TX_POWER     - power on
+ *   TX_SWITCH    - switch requests and queries
+ *   TX_LOCO      - locomotive commands
+ * All messages we send have at most 3 bytes, the checksum is added by
+ * the LocoNet library.
+ *
+ * Switch requests are coalesced: when a request for the same turnout (and
+ * output) is still waiting in the queue, only its direction is updated.
+ * Pressing a switch button several times quickly thus sends only the
+ * final position, instead of every position in between.
+ *
+ * Sending is paced by a token bucket, so the command station is not
+ * flooded: every message takes a token, tokens are added at txRate per
+ * second up to a maximum of txBurst. Power off never waits for a token,
+ * and neither do switch state queries: they do not load the track, and
+ * syncState() asks the next one only after the answer to the last.
+ * Both can be changed at runtime over serial, see handleSerial().
+ *
+ * With txAdaptive on, the rate follows the command station: the time
+ * between a switch request and the station's OPC_SW_REP for it is
+ * averaged in txRtt. While reports come back within TX_RTT_FAST ms the
+ * rate goes up by one, when they take longer than TX_RTT_SLOW ms, or do
+ * not come within txReportWait() ms, the rate is halved, always between
+ * TX_RATE_MIN and TX_RATE_MAX. The echo of our own frame is no measure,
+ * Loconet returns it right away. A report that comes after its request
+ * was given up still counts in txRtt, so the wait grows with a slow
+ * station instead of giving up on every request.
+ *
+ * The station executes accessory commands one at a time from a queue of
+ * its own, and drops what does not fit. So at most TX_WINDOW switch
+ * requests are sent without their report, the next one waits for a
+ * report or a timeout.
+ * ------------------------------------------------------------------------- */
+#define TX_EMERGENCY  0                     // Priority
+#define TX_POWER      1                     //  classes
+#define TX_SWITCH     2                     //   highest
+#define TX_LOCO       3                     //    first
+#define TX_CLASSES    4
+
+#define TX_QUEUE_SIZE 16                    // Messages per priority class
+#define TX_MAX_TRIES   3                    // Sends before giving up,
+                                            //  never for TX_EMERGENCY
+
+#define TX_RATE       10                    // Default messages per second
+#define TX_BURST       4                    // Default max messages at once
+#define TX_TOKEN    1000                    // One token, in 1/1000 tokens
+
+#define TX_ADAPTIVE    1                    // Default adaptive pacing on
+#define TX_RATE_MIN    2                    // Adaptive rate limits
+#define TX_RATE_MAX   50                    //  in messages per second
+#define TX_RTT_FAST  100                    // Report in ms, faster below
+#define TX_RTT_SLOW  300                    //  slower above
+#define TX_RTT_LOST  500                    //  lost after, at least,
+#define TX_RTT_TIMES   2                    //  or this times txRtt
+#define TX_WINDOW      4                    // Requests awaiting a report
+#define TX_FLIGHTS    (2 * TX_WINDOW)       //  and given up ones kept
+
+struct TXFRAME {
+  byte data[3];                             // Opcode and 2 data bytes
+  unsigned long queued;                     // micros() when queued
+  byte tries;                               // Failed sends
+#if KEY_TRACE && DEBUG_LVL > 0
+  byte mark;                                // Element + 1 of the key
+#endif
+};
+
+struct TXQUEUE {
+  TXFRAME frame[TX_QUEUE_SIZE];
+  byte head;                                // Oldest message
+  byte count;                               // Messages in the queue
+};
+
+struct TXFLIGHT {
+  int address;                              // As in the message
+  unsigned long sent;                       // millis() when sent
+  bool lost;                                // Given up, report is late
+};
+
+TXQUEUE txq[TX_CLASSES];
+TXFLIGHT txFlight[TX_FLIGHTS];              // Oldest first
+byte txInFlight = 0;                        // Entries in txFlight
+byte txLate = 0;                            //  of which lost
+
+int  txRate  = TX_RATE;                     // Token bucket settings
+int  txBurst = TX_BURST;
+unsigned long txTokens = TX_BURST * (unsigned long)TX_TOKEN;
+unsigned long txRefilled = 0;               // millis() of last refill
+bool txAdaptive = TX_ADAPTIVE;              // Follow the report times
+unsigned long txRtt = 0;                    // Average report time in ms
+
+unsigned long txSent    = 0;                // Statistics
+unsigned long txDropped = 0;
+unsigned long txErrors  = 0;
+unsigned long txBusy    = 0;                // Tries the line was not free
+unsigned long txCoalesced = 0;              // Switch requests merged
+unsigned long txLatSum  = 0;                // us from queued to sent
+unsigned long txLatMax  = 0;
+byte          txDepthMax = 0;               // Max messages queued at once
+unsigned long txWaits   = 0;                // Passes waiting for a token
+unsigned long txWindowWaits = 0;            //  or for a report
+unsigned long txReportsLost = 0;
+unsigned long txLastSent  = 0;              // For the throughput report
+unsigned long txLastStats = 0;
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 txDepth()
+ * Number of messages waiting in all queues
+ * ------------------------------------------------------------------------- */
+int txDepth() {
+  int depth = 0;
+  for (int c = 0; c < TX_CLASSES; c++) {
+    depth += txq[c].count;
+  }
+  return depth;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 txQueue()
+ * Queue a message, returns false (and counts it) when the queue is full
+ * ------------------------------------------------------------------------- */
+bool txQueue(byte prio, byte opcode, byte data1, byte data2) {
+  TXQUEUE *q = &txq[prio];
+
+  if (opcode == OPC_SW_REQ) {               // Same switch still waiting?
+    for (byte n = 0; n < q->count; n++) {
+      TXFRAME *f = &q->frame[(q->head + n) % TX_QUEUE_SIZE];
+      if (f->data[0] == OPC_SW_REQ && f->data[1] == data1 &&
+          (f->data[2] & ~B00100000) == (data2 & ~B00100000)) {
+        f->data[2] = data2;                 // Only the direction differs
+#if KEY_TRACE && DEBUG_LVL > 0
+        f->mark = ktCurrent;
+#endif
+        txCoalesced++;
+        return true;
+      }
+    }
+  }
+
+  if (q->count >= TX_QUEUE_SIZE) {
+    txDropped++;
+    debugln(F("--- txQueue:queue full, message dropped"));
+    if (opcode == OPC_SW_REQ && (data2 & B00010000)) {
+      confirmUnsent(((data2 & 0x0F) << 7) | data1,
+                    (data2 & B00100000) ? STRAIGHT : THROWN);
+    }
+    return false;
+  }
+
+  TXFRAME *f = &q->frame[(q->head + q->count) % TX_QUEUE_SIZE];
+  f->data[0] = opcode;
+  f->data[1] = data1;
+  f->data[2] = data2;
+  f->queued  = micros();
+  f->tries   = 0;
+#if KEY_TRACE && DEBUG_LVL > 0
+  f->mark    = ktCurrent;                   // Queued for a key press?
+#endif
+  q->count++;
+
+  int depth = txDepth();
+  if (depth > txDepthMax) txDepthMax = depth;
+
+  return true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                txRefill()
+ * Add the tokens earned since the last refill to the bucket
+ * ------------------------------------------------------------------------- */
+void txRefill() {
+  unsigned long now = millis();
+  unsigned long full = txBurst * (unsigned long)TX_TOKEN;
+  unsigned long elapsed = now - txRefilled;
+  txRefilled = now;
+
+  if (elapsed >= full) {                    // Long idle (and no overflow)
+    txTokens = full;
+  } else {
+    txTokens += elapsed * txRate;           // ms * msg/s = 1/1000 tokens
+    if (txTokens > full) txTokens = full;
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               txSetRate()
+ * Change the token bucket, values below 1 are ignored
+ * ------------------------------------------------------------------------- */
+void txSetRate(int rate, int burst) {
+  if (rate  > 0) txRate  = rate;
+  if (burst > 0) txBurst = burst;
+  txRefill();                               // Apply the new maximum
+
+  debug(F("Loconet rate: ")); debug(txRate);
+  debug(F(" msg/s, burst: ")); debug(txBurst);
+  debug(txAdaptive ? F(", adaptive, report ms: ") : F(", fixed, report ms: "));
+  debugln(txRtt);
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          txEcho(), txLost()
+ * Adapt the rate to the report time of a switch request, or to a lost one
+ * ------------------------------------------------------------------------- */
+void txLost() {
+  if (!txAdaptive) return;
+  txRate = txRate / 2;
+  if (txRate < TX_RATE_MIN) txRate = TX_RATE_MIN;
+}
+
+void txEcho(unsigned long rtt) {
+  txRtt = txRtt ? (txRtt * 7 + rtt) / 8 : rtt;  // Running average
+
+  if (!txAdaptive) return;
+  if (txRtt < TX_RTT_FAST && txRate < TX_RATE_MAX) {
+    txRate++;                               // Prompt, speed up a bit
+  } else if (txRtt > TX_RTT_SLOW) {
+    txLost();                               // Lagging, back off
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            txReportWait()
+ * ms to wait for the report of a switch request, TX_RTT_TIMES the average
+ * report time, but at least TX_RTT_LOST
+ * ------------------------------------------------------------------------- */
+unsigned long txReportWait() {
+  unsigned long wait = TX_RTT_TIMES * txRtt;
+  return wait > TX_RTT_LOST ? wait : TX_RTT_LOST;
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                       txFly(), txReport(), txExpire()
+ * txFly() notes a switch request sent. txReport() for every OPC_SW_REP
+ * (address as in the message) matches the oldest request for it, also a
+ * lost one. txExpire() gives up on the ones without a report in time, they
+ * no longer count for TX_WINDOW but are kept for a late report, until
+ * their place is needed.
+ * ------------------------------------------------------------------------- */
+void txForget(byte n) {
+  if (txFlight[n].lost) txLate--;
+  txInFlight--;
+  for (; n < txInFlight; n++) txFlight[n] = txFlight[n + 1];
+}
+
+void txFly(int address) {
+  if (txInFlight == TX_FLIGHTS) txForget(0);  // Oldest is a lost one
+  txFlight[txInFlight].address = address;
+  txFlight[txInFlight].sent = millis();
+  txFlight[txInFlight].lost = false;
+  txInFlight++;
+}
+
+void txReport(int address) {
+  for (byte n = 0; n < txInFlight; n++) {
+    if (txFlight[n].address == address) {
+      txEcho(millis() - txFlight[n].sent);
+      txForget(n);
+      return;
+    }
+  }
+}
+
+void txExpire() {
+  unsigned long wait = txReportWait();
+  for (byte n = 0; n < txInFlight; n++) {
+    if (txFlight[n].lost) continue;
+    if (millis() - txFlight[n].sent < wait) break;  // Newer ones neither
+    txFlight[n].lost = true;
+    txLate++;
+    txReportsLost++;
+    txLost();
+  }
+}
+
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  txSend()
+ * Send the message with the highest priority, if any, and if there is a
+ * token for it. LocoNet.send() with a priority delay makes one try only,
+ * it does not wait for the line like LocoNet.send(msg) does. When the line
+ * is not free (backoff) the message stays in front of its queue for the
+ * next pass. So does a message that collided, each message counts its own
+ * failures. After TX_MAX_TRIES it is dropped, except power off, that is
+ * tried until it goes. Only a message sent takes a token.
+ * ------------------------------------------------------------------------- */
+void txSend() {
+  txExpire();
+
+  int c = 0;
+  while (c < TX_CLASSES && txq[c].count == 0) c++;
+  if (c == TX_CLASSES) return;              // Nothing to send
+
+  TXQUEUE *q = &txq[c];
+  TXFRAME *f = &q->frame[q->head];
+  bool request = f->data[0] == OPC_SW_REQ && (f->data[2] & B00010000);
+
+  if (request && txInFlight - txLate >= TX_WINDOW) {
+    txWindowWaits++;
+    return;                                 // Station still busy
+  }
+
+  bool paced = c != TX_EMERGENCY && f->data[0] != OPC_SW_STATE;
+  if (paced) {                              // Those two never wait
+    txRefill();
+    if (txTokens < TX_TOKEN) {
+      txWaits++;
+      return;                               // Not yet
+    }
+  }
+
+  lnMsg SendPacket;
+  SendPacket.data[ 0 ] = f->data[0];
+  SendPacket.data[ 1 ] = f->data[1];
+  SendPacket.data[ 2 ] = f->data[2];
+
+  LN_STATUS status = LocoNet.send( &SendPacket, LN_BACKOFF_MIN );
+  if (status == LN_CD_BACKOFF || status == LN_PRIO_BACKOFF ||
+      status == LN_NETWORK_BUSY) {
+    txBusy++;
+    return;                                 // Line not free yet
+  }
+
+  LOOP_TAG(LT_TX);
+  if (status != LN_DONE) {                  // Collision
+    txErrors++;
+    if (c == TX_EMERGENCY) return;          // Power off: until it goes
+    if (++f->tries < TX_MAX_TRIES) return;  // Try again next pass
+    txDropped++;
+    debugln(F("--- txSend:message dropped"));
+    if (request) {
+      confirmUnsent(((f->data[2] & 0x0F) << 7) | f->data[1],
+                    (f->data[2] & B00100000) ? STRAIGHT : THROWN);
+    }
+  } else {
+    if (paced) txTokens -= TX_TOKEN;
+    if (request) {
+      int address = ((f->data[2] & 0x0F) << 7) | f->data[1];
+      txFly(address);
+      confirmSent(address, (f->data[2] & B00100000) ? STRAIGHT : THROWN);
+    }
+    unsigned long latency = micros() - f->queued;
+    ktSent(f->mark);
+    txLatSum += latency;
+    if (latency > txLatMax) txLatMax = latency;
+    txSent++;
+  }
+
+  q->head = (q->head + 1) % TX_QUEUE_SIZE;
+  q->count--;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 txStats()
+ * Testing purposes: show the send queue statistics
+ * ------------------------------------------------------------------------- */
+void txStats() {
+  debug(F("Loconet sent: ")); debug(txSent);
+  debug(F(", dropped: ")); debug(txDropped);
+  debug(F(", errors: ")); debug(txErrors);
+  debug(F(", busy: ")); debug(txBusy);
+  debug(F(", coalesced: ")); debugln(txCoalesced);
+  debug(F("Loconet queue now: ")); debug(txDepth());
+  debug(F(", max: ")); debugln(txDepthMax);
+  debug(F("Loconet latency us avg: ")); debug(txSent ? txLatSum / txSent : 0);
+  debug(F(", max: ")); debugln(txLatMax);
+
+  unsigned long now = millis();             // Throughput since last report
+  debug(F("Loconet throughput msg/s: "));
+  debug(now > txLastStats ? (txSent - txLastSent) * 1000.0 / (now - txLastStats) : 0.0);
+  debug(F(", token waits: ")); debug(txWaits);
+  debug(F(", report waits: ")); debugln(txWindowWaits);
+  debug(F("Loconet in flight: ")); debug(txInFlight - txLate);
+  debug(F(", reports lost: ")); debug(txReportsLost);
+  debug(F(", wait ms: ")); debugln(txReportWait());
+  txLastSent  = txSent;
+  txLastStats = now;
+
+  txSetRate(0, 0);                          // Show current settings
+}
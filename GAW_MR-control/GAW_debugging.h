@@ -11,12 +11,30 @@
  * ------------------------------------------------------------------------- */
 #define DEBUG_LVL 1
 
+/* ------------------------------------------------------------------------- *
+ * LOOP_PROFILE:
+ *   0 - no loop() timing
+ *   1 - histogram of loop() times, see GAW_MR_looptime.h (needs DEBUG_LVL)
+ *       Takes some 480 bytes of SRAM, only switch on to measure
+ * ------------------------------------------------------------------------- */
+#define LOOP_PROFILE 0
+
+/* ------------------------------------------------------------------------- *
+ * KEY_TRACE:
+ *   0 - no key press tracing
+ *   1 - trace key press to Loconet and LEDs, see GAW_MR_keytrace.h
+ *       Takes some 430 bytes of SRAM, only switch on to measure
+ * ------------------------------------------------------------------------- */
+#define KEY_TRACE 0
+
 #if DEBUG_LVL > 0
 #define debugstart(x) Serial.begin(x)
 #define debug(x) Serial.print(x)
 #define debugln(x) Serial.println(x)
+#define debugfmt(x,f) Serial.print(x,f)
 #else
 #define debugstart(x)
 #define debug(x)
 #define debugln(x)
+#define debugfmt(x,f)
 #endif
@@ -0,0 +1,149 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Host benchmarks of GAW_MR-control
+ *
+ * ------------------------------------------------------------------------- */
+#include "bench.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "GAW_MR_defines.h"
+
+#include <chrono>
+#include <vector>
+
+namespace layout {                          // The sketch's element table,
+#include "GAW_MR_layout.h"                  //  apart from the sketch's own
+}
+
+
+int findSwitch(uint16_t address);           // In the sketch
+int linearFindSwitch(uint16_t address);
+uint16_t elemAddress(int index);
+extern byte swIndex[];
+extern int  nSwIndex;
+
+#define BENCH_ROUNDS 100000                 // Passes over the test data
+
+static volatile int benchSink;              // Keep the compiler honest
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 benchNs()
+ * Host nanoseconds per operation of run(), which does count of them
+ * ------------------------------------------------------------------------- */
+template <typename F> static double benchNs(unsigned long count, F run) {
+  auto start = std::chrono::steady_clock::now();
+  run();
+  std::chrono::duration<double, std::nano> ns =
+    std::chrono::steady_clock::now() - start;
+  return ns.count() / count;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             benchLookup()
+ * findSwitch() against the old linear scan of element[], for every switch
+ * address plus one unknown address
+ * ------------------------------------------------------------------------- */
+static void benchLookup() {
+  std::vector<uint16_t> addresses;
+  for (int i = 0; i < nSwIndex; i++) addresses.push_back(elemAddress(swIndex[i]));
+  addresses.push_back(0xFFFF);
+  unsigned long lookups = BENCH_ROUNDS * addresses.size();
+
+  double linear = benchNs(lookups, [&] {
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      for (uint16_t a : addresses) benchSink = linearFindSwitch(a);
+    }
+  });
+  double indexed = benchNs(lookups, [&] {
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+      for (uint16_t a : addresses) benchSink = findSwitch(a);
+    }
+  });
+
+  printf("switch lookup ns per lookup: linear %.1f, indexed %.1f (%d switches)\n",
+         linear, indexed, nSwIndex);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                           benchElements()
+ * One pass over all elements, reading type, module and address, and one
+ * store of the states, as storeState() does. The old layout kept all of
+ * an element in SRAM, with the AVR's 2 byte int fields, and stored it
+ * whole. The new one reads the definition from flash, and stores only the
+ * 2 byte state of the elements that are not switches. Both store into an
+ * EEPROM of their own, unchanged after the first round, so that is only
+ * the compare per byte.
+ * ------------------------------------------------------------------------- */
+struct __attribute__((packed)) OldMR_data { // Before: int is 2 bytes on AVR
+  int16_t  type;
+  int16_t  module;
+  uint16_t address;
+  uint8_t  state;
+  int16_t  state2;
+};
+
+static void benchElements() {
+  const int n = sizeof(layout::element) / sizeof(layout::element[0]);
+  layout::elementDefaults();
+  std::vector<OldMR_data> old(n);
+  for (int i = 0; i < n; i++) {
+    old[i].type    = layout::elemType(i);
+    old[i].module  = layout::elemModule(i);
+    old[i].address = layout::elemAddress(i);
+    old[i].state   = layout::element[i].state;
+    old[i].state2  = layout::element[i].state2;
+  }
+  EEPROMClass oldRom, newRom;
+  unsigned long passes = BENCH_ROUNDS / 10;
+
+  double oldScan = benchNs(passes, [&] {
+    for (unsigned long r = 0; r < passes; r++) {
+      for (int i = 0; i < n; i++) {
+        benchSink = old[i].type + old[i].module + old[i].address;
+      }
+    }
+  });
+  double newScan = benchNs(passes, [&] {
+    for (unsigned long r = 0; r < passes; r++) {
+      for (int i = 0; i < n; i++) {
+        benchSink = layout::elemType(i) + layout::elemModule(i) +
+                    layout::elemAddress(i);
+      }
+    }
+  });
+  double oldStore = benchNs(passes, [&] {
+    for (unsigned long r = 0; r < passes; r++) {
+      for (int i = 0; i < n; i++) {
+        oldRom.put(i * sizeof(OldMR_data), old[i]);
+      }
+    }
+  });
+  double newStore = benchNs(passes, [&] {
+    for (unsigned long r = 0; r < passes; r++) {
+      for (int i = 0; i < n; i++) {
+        if (layout::elemType(i) == TYPE_SWITCH) continue;
+        newRom.put(i * sizeof(layout::MR_state), layout::element[i]);
+      }
+    }
+  });
+
+  int oldBytes = n * sizeof(OldMR_data);
+  int newBytes = (n - layout::nSwitches) * sizeof(layout::MR_state);
+  printf("elements ns per pass: scan old %.1f, new %.1f; store old %.1f, new %.1f\n",
+         oldScan, newScan, oldStore, newStore);
+  printf("  %d elements, stored old %d, new %d bytes\n", n, oldBytes, newBytes);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                benchRun()
+ * ------------------------------------------------------------------------- */
+void benchRun() {
+  printf("\n=== benchmarks, host time ===\n");
+  benchLookup();
+  benchElements();
+}
@@ -0,0 +1,14 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Host benchmarks of GAW_MR-control
+ *
+ * The sketch can not time itself on the host: micros() is the virtual
+ * clock there, which does not move while sketch code runs. These
+ * benchmarks call the sketch code many times after setup() and time it
+ * with the host clock (std::chrono::steady_clock). The results are host
+ * nanoseconds, to compare two ways of doing the same, not AVR cycles.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+
+void benchRun();                            // Run all, print the results
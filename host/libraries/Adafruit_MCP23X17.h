@@ -0,0 +1,35 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Adafruit MCP23X17 library, host simulation
+ *
+ * Only the calls the sketch uses, with the same I2C traffic as the real
+ * library: begin_I2C() probes the address, writeGPIOAB() writes GPIOA and
+ * GPIOB in one transmission.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+#include "Wire.h"
+
+class Adafruit_MCP23X17 {
+ public:
+  bool begin_I2C(uint8_t i2c_addr = 0x20, TwoWire *wire = &Wire) {
+    address = i2c_addr;
+    bus = wire;
+    bus->begin();
+    bus->beginTransmission(address);
+    return bus->endTransmission() == 0;
+  }
+
+  void writeGPIOAB(uint16_t value) {
+    bus->beginTransmission(address);
+    bus->write(0x12);                       // GPIOA, GPIOB follows
+    bus->write(value & 0xFF);
+    bus->write(value >> 8);
+    bus->endTransmission();
+  }
+
+ private:
+  uint8_t address = 0x20;
+  TwoWire *bus = &Wire;
+};
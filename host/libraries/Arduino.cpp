@@ -0,0 +1,111 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Arduino core, host simulation
+ *
+ * ------------------------------------------------------------------------- */
+#include "Arduino.h"
+#include "sim.h"
+
+
+HardwareSerial Serial;
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                      Time
+ * ------------------------------------------------------------------------- */
+unsigned long millis() {
+  return simTime / 1000;
+}
+
+unsigned long micros() {
+  return simTime;
+}
+
+void delay(unsigned long ms) {
+  simAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simAdvance(us);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                    Pins, the panel only has LEDs on them
+ * ------------------------------------------------------------------------- */
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int  digitalRead(uint8_t pin) { return LOW; }
+int  analogRead(uint8_t pin) { return 0; }
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                           ltoa(), String
+ * ------------------------------------------------------------------------- */
+char *ltoa(long value, char *buf, int base) {
+  if (base == HEX) {
+    sprintf(buf, "%lx", (unsigned long)value);
+  } else {
+    sprintf(buf, "%ld", value);
+  }
+  return buf;
+}
+
+String::String(int v, int base) : String((long)v, base) {}
+String::String(unsigned int v, int base) : String((unsigned long)v, base) {}
+
+String::String(long v, int base) {
+  char buf[24];
+  s_ = ltoa(v, buf, base);
+}
+
+String::String(unsigned long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof buf, base == HEX ? "%lx" : "%lu", v);
+  s_ = buf;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                     Print
+ * ------------------------------------------------------------------------- */
+size_t Print::print(const char *s) {
+  size_t n = 0;
+  while (*s) n += write(*s++);
+  return n;
+}
+
+size_t Print::print(long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof buf, base == HEX ? "%lX" : "%ld", v);
+  return print(buf);
+}
+
+size_t Print::print(unsigned long v, int base) {
+  char buf[24];
+  snprintf(buf, sizeof buf, base == HEX ? "%lX" : "%lu", v);
+  return print(buf);
+}
+
+size_t Print::print(double v, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof buf, "%.*f", digits, v);
+  return print(buf);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            HardwareSerial
+ * ------------------------------------------------------------------------- */
+int HardwareSerial::available() {
+  return simSerialAvailable();
+}
+
+int HardwareSerial::read() {
+  return simSerialRead();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (!simQuiet && c != '\r') putchar(c);
+  return 1;
+}
@@ -0,0 +1,132 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Arduino core, host simulation
+ *
+ * Only what GAW_MR-control uses. Flash is ordinary memory on the host, so
+ * PROGMEM and F() are no-ops and the pgm_read_*() macros plain reads.
+ * Time comes from the virtual clock, see sim.h.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH    1
+#define LOW     0
+#define INPUT   0
+#define OUTPUT  1
+
+#define DEC    10
+#define HEX    16
+
+#define A0     54
+#define A1     55
+
+#define B00010000 0x10
+#define B00100000 0x20
+
+#define lowByte(w)  ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                     Flash
+ * ------------------------------------------------------------------------- */
+#define PROGMEM
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define pgm_read_byte(p)  (*(const uint8_t *)(p))
+#define pgm_read_word(p)  (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define memcpy_P memcpy
+#define memcmp_P memcmp
+#define strlen_P strlen
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     Time and digital pins
+ * ------------------------------------------------------------------------- */
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int  digitalRead(uint8_t pin);
+int  analogRead(uint8_t pin);
+
+char *ltoa(long value, char *buf, int base);
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                    String
+ * ------------------------------------------------------------------------- */
+class String {
+ public:
+  String(const char *s = "") : s_(s) {}
+  String(const __FlashStringHelper *s) : s_((const char *)s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, int base = 10);
+  String(unsigned int v, int base = 10);
+  String(long v, int base = 10);
+  String(unsigned long v, int base = 10);
+
+  const char *c_str() const { return s_.c_str(); }
+  unsigned int length() const { return s_.size(); }
+
+  friend String operator+(const String &a, const String &b) {
+    String r; r.s_ = a.s_ + b.s_; return r;
+  }
+  friend String operator+(const String &a, const char *b) { return a + String(b); }
+  friend String operator+(const char *a, const String &b) { return String(a) + b; }
+  friend String operator+(const String &a, const __FlashStringHelper *b) {
+    return a + String(b);
+  }
+
+ private:
+  std::string s_;
+};
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          Print and Serial
+ * ------------------------------------------------------------------------- */
+class Print {
+ public:
+  virtual size_t write(uint8_t c) = 0;
+  virtual ~Print() {}
+
+  size_t print(const char *s);
+  size_t print(const __FlashStringHelper *s) { return print((const char *)s); }
+  size_t print(const String &s) { return print(s.c_str()); }
+  size_t print(char c) { return write(c); }
+  size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(int v, int base = DEC) { return print((long)v, base); }
+  size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+  size_t print(long v, int base = DEC);
+  size_t print(unsigned long v, int base = DEC);
+  size_t print(double v, int digits = 2);
+
+  size_t println() { return print("\r\n"); }
+  template <typename T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template <typename T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+};
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) {}
+  int available();
+  int read();
+  size_t write(uint8_t c) override;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,47 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the EEPROM library, host simulation
+ *
+ * 4 KB, like the Mega 2560, erased (0xFF) at start unless the simulation
+ * loads an image. As in the real library put() only writes changed bytes,
+ * and every byte written costs the 3.3 ms of an AVR EEPROM write.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+#include "sim.h"
+
+#define EEPROM_WRITE_US 3300                // Time per byte written
+
+class EEPROMClass {
+ public:
+  EEPROMClass() { memset(mem, 0xFF, sizeof mem); }
+
+  uint8_t read(int address) const { return mem[address]; }
+
+  void write(int address, uint8_t value) {
+    mem[address] = value;
+    simAdvance(EEPROM_WRITE_US);
+  }
+
+  void update(int address, uint8_t value) {
+    if (mem[address] != value) write(address, value);
+  }
+
+  uint16_t length() const { return sizeof mem; }
+
+  template <typename T> T &get(int address, T &t) const {
+    memcpy((void *)&t, mem + address, sizeof(T));
+    return t;
+  }
+
+  template <typename T> const T &put(int address, const T &t) {
+    const uint8_t *p = (const uint8_t *)&t;
+    for (size_t i = 0; i < sizeof(T); i++) update(address + i, p[i]);
+    return t;
+  }
+
+  uint8_t mem[4096];
+};
+
+extern EEPROMClass EEPROM;
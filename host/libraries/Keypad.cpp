@@ -0,0 +1,22 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Keypad library, host simulation
+ *
+ * ------------------------------------------------------------------------- */
+#include "Keypad.h"
+#include "sim.h"
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  getKey()
+ * ------------------------------------------------------------------------- */
+char Keypad::getKey() {
+  char code = simKeyDue();
+  if (code == NO_KEY) return NO_KEY;
+
+  for (int i = 0; i < size; i++) {
+    if (keymap[i] == code) return code;
+  }
+  fprintf(stderr, "sim: keycode %d is not on the panel\n", code);
+  return NO_KEY;
+}
@@ -0,0 +1,25 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Keypad library, host simulation
+ *
+ * Keys are pressed by the simulation by their keycode, getKey() returns
+ * them one at a time, like the real library, when they are in the keymap.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+
+#define NO_KEY '\0'
+#define makeKeymap(x) ((char *)x)
+
+class Keypad {
+ public:
+  Keypad(char *userKeymap, byte *row, byte *col, byte numRows, byte numCols)
+    : keymap(userKeymap), size(numRows * numCols) {}
+
+  char getKey();
+
+ private:
+  char *keymap;
+  int size;
+};
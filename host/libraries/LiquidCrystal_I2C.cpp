@@ -0,0 +1,112 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the LiquidCrystal_I2C library, host simulation
+ *
+ * The I2C traffic and the delays follow the real library, so the virtual
+ * time spent on the display is about what the Mega spends.
+ *
+ * ------------------------------------------------------------------------- */
+#include "LiquidCrystal_I2C.h"
+#include "Wire.h"
+
+#define LCD_CLEARDISPLAY   0x01
+#define LCD_RETURNHOME     0x02
+#define LCD_ENTRYMODESET   0x06             // Left to right, no shift
+#define LCD_DISPLAYON      0x0C
+#define LCD_FUNCTIONSET    0x28             // 4 bit, 2 lines, 5x8
+#define LCD_SETDDRAMADDR   0x80
+
+#define LCD_BACKLIGHT      0x08             // PCF8574 bits
+#define En                 0x04
+#define Rs                 0x01
+
+
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t lcd_Addr, uint8_t lcd_cols, uint8_t lcd_rows)
+  : address(lcd_Addr), cols(lcd_cols), rows(lcd_rows) {
+  memset(screen, ' ', sizeof screen);
+  for (int r = 0; r < 4; r++) screen[r][cols] = '\0';
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                    init()
+ * Power up sequence of the HD44780 in 4 bit mode
+ * ------------------------------------------------------------------------- */
+void LiquidCrystal_I2C::init() {
+  Wire.begin();
+  delay(50);
+  expanderWrite(light);
+  delay(1000);
+
+  write4bits(0x03 << 4); delayMicroseconds(4500);
+  write4bits(0x03 << 4); delayMicroseconds(4500);
+  write4bits(0x03 << 4); delayMicroseconds(150);
+  write4bits(0x02 << 4);
+
+  send(LCD_FUNCTIONSET, 0);
+  send(LCD_DISPLAYON, 0);
+  clear();
+  send(LCD_ENTRYMODESET, 0);
+  send(LCD_RETURNHOME, 0);
+  delayMicroseconds(2000);
+}
+
+void LiquidCrystal_I2C::clear() {
+  send(LCD_CLEARDISPLAY, 0);
+  delayMicroseconds(2000);
+  memset(screen, ' ', sizeof screen);
+  for (int r = 0; r < 4; r++) screen[r][cols] = '\0';
+  curCol = curRow = 0;
+}
+
+void LiquidCrystal_I2C::backlight() {
+  light = LCD_BACKLIGHT;
+  expanderWrite(0);
+}
+
+void LiquidCrystal_I2C::noBacklight() {
+  light = 0;
+  expanderWrite(0);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     setCursor(), write()
+ * ------------------------------------------------------------------------- */
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row) {
+  static const uint8_t rowOffsets[] = { 0x00, 0x40, 0x14, 0x54 };
+  if (row >= rows) row = rows - 1;
+  send(LCD_SETDDRAMADDR | (col + rowOffsets[row]), 0);
+  curCol = col;
+  curRow = row;
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t value) {
+  send(value, Rs);
+  if (curRow < 4 && curCol < cols) screen[curRow][curCol] = value;
+  curCol++;
+  return 1;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                    send(), write4bits(), expanderWrite()
+ * ------------------------------------------------------------------------- */
+void LiquidCrystal_I2C::send(uint8_t value, uint8_t mode) {
+  write4bits((value & 0xF0) | mode);
+  write4bits(((value << 4) & 0xF0) | mode);
+}
+
+void LiquidCrystal_I2C::write4bits(uint8_t value) {
+  expanderWrite(value);
+  expanderWrite(value | En);                // Strobe
+  delayMicroseconds(1);
+  expanderWrite(value & ~En);
+  delayMicroseconds(50);
+}
+
+void LiquidCrystal_I2C::expanderWrite(uint8_t data) {
+  Wire.beginTransmission(address);
+  Wire.write(data | light);
+  Wire.endTransmission();
+}
@@ -0,0 +1,36 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the LiquidCrystal_I2C library, host simulation
+ *
+ * Keeps the characters on screen for the simulation report. Every
+ * character and command goes over I2C like on the PCF8574 backpack: two
+ * nibbles, each written and strobed with three single byte transmissions.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+
+class LiquidCrystal_I2C : public Print {
+ public:
+  LiquidCrystal_I2C(uint8_t lcd_Addr, uint8_t lcd_cols, uint8_t lcd_rows);
+
+  void init();
+  void clear();
+  void backlight();
+  void noBacklight();
+  void setCursor(uint8_t col, uint8_t row);
+  size_t write(uint8_t value) override;
+  using Print::write;
+
+  const char *line(int row) const { return screen[row]; }
+
+ private:
+  void send(uint8_t value, uint8_t mode);
+  void write4bits(uint8_t value);
+  void expanderWrite(uint8_t data);
+
+  uint8_t address, cols, rows;
+  uint8_t light = 0;
+  uint8_t curCol = 0, curRow = 0;
+  char screen[4][41];
+};
@@ -0,0 +1,181 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the mrrwa LocoNet library, host simulation
+ *
+ * ------------------------------------------------------------------------- */
+#include "LocoNet.h"
+#include "sim.h"
+
+#include <map>
+#include <random>
+
+
+LocoNetClass LocoNet;
+
+unsigned long simLnSent = 0;
+unsigned long simLnReceived = 0;
+void (*simLoconetTap)(const uint8_t *frame) = nullptr;
+
+struct Frame { uint8_t data[16]; };
+static std::multimap<unsigned long, Frame> rxQueue; // By time of arrival
+static lnMsg rxMsg;                         // Returned by receive()
+
+static std::multimap<unsigned long, int> collisions; // Percent, from then on
+static std::mt19937 txRng(1);
+static unsigned long lineFree = 0;          // End of the last traffic
+unsigned long simLnCollisions = 0;
+
+// Call-backs, the sketch defines the ones it needs
+extern void notifyPower(uint8_t State) __attribute__((weak));
+extern void notifySensor(uint16_t Address, uint8_t State) __attribute__((weak));
+extern void notifySwitchRequest(uint16_t Address, uint8_t Output, uint8_t Direction) __attribute__((weak));
+extern void notifySwitchReport(uint16_t Address, uint8_t Output, uint8_t Direction) __attribute__((weak));
+extern void notifySwitchOutputsReport(uint16_t Address, uint8_t ClosedOutput, uint8_t ThrownOutput) __attribute__((weak));
+extern void notifySwitchState(uint16_t Address, uint8_t Output, uint8_t Direction) __attribute__((weak));
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            getLnMsgSize()
+ * ------------------------------------------------------------------------- */
+uint8_t getLnMsgSize(lnMsg *msg) {
+  switch (msg->data[0] & 0x60) {
+    case 0x00: return 2;
+    case 0x20: return 4;
+    case 0x40: return 6;
+    default:   return msg->data[1] & 0x0F;
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                       simLoconetReceive()
+ * ------------------------------------------------------------------------- */
+void simLoconetReceive(unsigned long at, const uint8_t *frame) {
+  Frame f;
+  memset(f.data, 0, sizeof f.data);
+  memcpy(f.data, frame, getLnMsgSize((lnMsg *)frame));
+  rxQueue.insert(std::make_pair(at, f));
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                 receive()
+ * ------------------------------------------------------------------------- */
+lnMsg *LocoNetClass::receive() {
+  if (rxQueue.empty() || rxQueue.begin()->first > simTime) return nullptr;
+  memcpy(rxMsg.data, rxQueue.begin()->second.data, sizeof rxMsg.data);
+  rxQueue.erase(rxQueue.begin());
+  simLnReceived++;
+  return &rxMsg;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     simLoconetCollisions()
+ * ------------------------------------------------------------------------- */
+void simLoconetCollisions(unsigned long at, int percent) {
+  collisions.insert(std::make_pair(at, percent));
+}
+
+static int collisionPercent() {
+  int percent = 0;
+  for (auto &c : collisions) {
+    if (c.first > simTime) break;
+    percent = c.second;
+  }
+  return percent;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                    send()
+ * One try: the line must have been free for prioDelay bit times since
+ * the last frame sent. A collision takes the first byte and the break on
+ * the wire, then the line is busy for LN_BACKOFF_MAX bit times more. A frame that goes takes its time on the
+ * wire, then it is echoed back.
+ * ------------------------------------------------------------------------- */
+LN_STATUS LocoNetClass::send(lnMsg *msg, uint8_t prioDelay) {
+  if (simTime < lineFree + prioDelay * LN_BIT_US) return LN_CD_BACKOFF;
+
+  int percent = collisionPercent();
+  if (percent > 0 && (int)(txRng() % 100) < percent) {
+    simAdvance((10 + 15) * LN_BIT_US);      // First byte and the break
+    lineFree = simTime + LN_BACKOFF_MAX * LN_BIT_US;
+    simLnCollisions++;
+    return LN_COLLISION;
+  }
+
+  uint8_t size = getLnMsgSize(msg);
+  uint8_t check = 0xFF;
+  for (int i = 0; i < size - 1; i++) check ^= msg->data[i];
+  msg->data[size - 1] = check;
+
+  simAdvance(size * 10 * LN_BIT_US);
+  lineFree = simTime;
+  simLnSent++;
+  simLoconetReceive(simTime, msg->data);    // Our own echo
+  if (simLoconetTap) simLoconetTap(msg->data);
+  return LN_DONE;
+}
+
+LN_STATUS LocoNetClass::send(lnMsg *msg) {  // Blocks until sent
+  for (int tries = 0; tries < LN_TX_RETRIES_MAX; tries++) {
+    LN_STATUS status;
+    while ((status = send(msg, LN_BACKOFF_MIN)) == LN_CD_BACKOFF) {
+      simAdvance(LN_BIT_US);                // Wait for the line
+    }
+    if (status == LN_DONE) return LN_DONE;
+  }
+  return LN_RETRY_ERROR;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                              processSwitchSensorMessage()
+ * ------------------------------------------------------------------------- */
+uint8_t LocoNetClass::processSwitchSensorMessage(lnMsg *msg) {
+  uint8_t d1 = msg->data[1];
+  uint8_t d2 = msg->data[2];
+  uint16_t address = (d1 | ((d2 & 0x0F) << 7)) + 1;
+
+  switch (msg->data[0]) {
+    case OPC_GPON:
+      if (notifyPower) notifyPower(1);
+      break;
+
+    case OPC_GPOFF:
+      if (notifyPower) notifyPower(0);
+      break;
+
+    case OPC_INPUT_REP:
+      address = ((d1 | ((d2 & 0x0F) << 7)) << 1) + ((d2 & 0x20) ? 2 : 1);
+      if (notifySensor) notifySensor(address, d2 & 0x10);
+      break;
+
+    case OPC_SW_REQ:
+      if (notifySwitchRequest) {
+        notifySwitchRequest(address, d2 & OPC_SW_REQ_OUT, d2 & OPC_SW_REQ_DIR);
+      }
+      break;
+
+    case OPC_SW_REP:
+      if (d2 & OPC_SW_REP_INPUTS) {
+        if (notifySwitchReport) {
+          notifySwitchReport(address, d2 & OPC_SW_REP_HI, d2 & OPC_SW_REP_SW);
+        }
+      } else if (notifySwitchOutputsReport) {
+        notifySwitchOutputsReport(address, d2 & OPC_SW_REP_CLOSED, d2 & OPC_SW_REP_THROWN);
+      }
+      break;
+
+    case OPC_SW_STATE:
+      if (notifySwitchState) {
+        notifySwitchState(address, d2 & OPC_SW_REQ_OUT, d2 & OPC_SW_REQ_DIR);
+      }
+      break;
+
+    default:
+      return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,65 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the mrrwa LocoNet library, host simulation
+ *
+ * send() fills in the checksum and takes the time the frame needs on the
+ * wire (16.66 kbaud, 10 bits per byte). Like on a real Loconet the sender
+ * also receives its own frame. send(msg, prioDelay) makes one try, as in
+ * the real library: it returns LN_CD_BACKOFF while the line is not free,
+ * and LN_COLLISION when the frame collided. How often that happens is set
+ * by the simulation, see simLoconetCollisions(). send(msg) tries until the
+ * frame is sent, waiting for the line, at most LN_TX_RETRIES_MAX times.
+ * receive() returns the frames that are due
+ * by the virtual clock, processSwitchSensorMessage() calls the notify*()
+ * call-backs the sketch defines, as the real library does.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+
+#define OPC_GPOFF         0x82
+#define OPC_GPON          0x83
+#define OPC_SW_REQ        0xB0
+#define OPC_SW_REP        0xB1
+#define OPC_INPUT_REP     0xB2
+#define OPC_LONG_ACK      0xB4
+#define OPC_SW_STATE      0xBC
+
+#define OPC_SW_REQ_OUT    0x10              // sw2 bits
+#define OPC_SW_REQ_DIR    0x20
+#define OPC_SW_REP_INPUTS 0x40              // sn2 bits
+#define OPC_SW_REP_SW     0x20
+#define OPC_SW_REP_HI     0x10
+#define OPC_SW_REP_CLOSED 0x20
+#define OPC_SW_REP_THROWN 0x10
+
+#define LN_BIT_US         60                // 16.66 kbaud
+#define LN_CARRIER_TICKS  20                // Bit times, as in the library
+#define LN_MASTER_DELAY    6
+#define LN_INITIAL_PRIO_DELAY 20
+#define LN_BACKOFF_MIN    (LN_CARRIER_TICKS + LN_MASTER_DELAY)
+#define LN_BACKOFF_INITIAL (LN_BACKOFF_MIN + LN_INITIAL_PRIO_DELAY)
+#define LN_BACKOFF_MAX    (LN_BACKOFF_INITIAL + 10)
+#define LN_TX_RETRIES_MAX 25
+
+typedef enum {
+  LN_CD_BACKOFF = 0, LN_PRIO_BACKOFF, LN_NETWORK_BUSY, LN_DONE,
+  LN_COLLISION, LN_UNKNOWN_ERROR, LN_RETRY_ERROR
+} LN_STATUS;
+
+typedef union {
+  uint8_t data[16];
+} lnMsg;
+
+uint8_t getLnMsgSize(lnMsg *msg);
+
+class LocoNetClass {
+ public:
+  void init(uint8_t txPin = 47) {}
+  lnMsg *receive();
+  LN_STATUS send(lnMsg *msg);
+  LN_STATUS send(lnMsg *msg, uint8_t prioDelay);
+  uint8_t processSwitchSensorMessage(lnMsg *msg);
+};
+
+extern LocoNetClass LocoNet;
@@ -0,0 +1,55 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Wire (I2C) library, host simulation
+ *
+ * ------------------------------------------------------------------------- */
+#include "Wire.h"
+#include "sim.h"
+
+
+TwoWire Wire;
+
+unsigned long simI2cTransactions = 0;
+unsigned long simI2cBytes = 0;
+SimI2cDevice simI2c[128];
+
+static bool absent[128];                    // Devices that do not answer
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            simI2cAbsent()
+ * ------------------------------------------------------------------------- */
+void simI2cAbsent(uint8_t address) {
+  absent[address & 0x7F] = true;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                               beginTransmission(), write(), endTransmission()
+ * Returns 0 when done, 2 when the address is not acknowledged
+ * ------------------------------------------------------------------------- */
+void TwoWire::beginTransmission(uint8_t address) {
+  txAddress = address;
+  txBytes = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  txBytes++;
+  return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool stop) {
+  bool ack = !absent[txAddress & 0x7F];
+  int bytes = 1 + (ack ? txBytes : 0);      // Address, data after an ack
+  unsigned long us = (bytes * 9 + 2) * 1000000UL / clock; // + start, stop
+
+  simI2cTransactions++;
+  simI2cBytes += bytes;
+  SimI2cDevice &d = simI2c[txAddress & 0x7F];
+  d.transmissions++;
+  d.bytes += bytes;
+  d.busUs += us;
+  simAdvance(us);
+
+  return ack ? 0 : 2;
+}
@@ -0,0 +1,29 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Stand-in for the Wire (I2C) library, host simulation
+ *
+ * Every device answers, unless the simulation marks it absent. A
+ * transmission costs the virtual time it takes on the bus: start, address,
+ * data and stop, 9 clocks per byte at the bus clock (100 kHz default).
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include "Arduino.h"
+
+class TwoWire {
+ public:
+  void begin() {}
+  void setClock(uint32_t hz) { clock = hz; }
+
+  void beginTransmission(uint8_t address);
+  size_t write(uint8_t data);
+  uint8_t endTransmission(bool stop = true);
+
+  uint32_t clock = 100000;
+
+ private:
+  uint8_t txAddress = 0;
+  int txBytes = 0;
+};
+
+extern TwoWire Wire;
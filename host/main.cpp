@@ -0,0 +1,294 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Host simulation of GAW_MR-control
+ *
+ * Runs setup() and loop() of the unchanged sketch on the virtual clock,
+ * as fast as the host can, and reports throughput at the end.
+ *
+ *   gaw_mr_sim [options]
+ *     -t <s>          virtual seconds to run (10)
+ *     -l <us>         virtual cost of one loop() pass (50)
+ *     -k <ms>:<code>  press the key with this keycode at <ms>
+ *     -c <ms>:<text>  type a serial command at <ms>
+ *     -e <file>       EEPROM image, read at start, written at the end
+ *     -a <addr>       I2C device at this (hex) address does not answer
+ *     -q              no serial output from the sketch
+ *     -f <ms>         print the Loconet frames the sketch sends from <ms> on
+ *     -C <ms>:<pct>   from <ms> on this percentage of the Loconet send
+ *                     tries collides
+ *     -B              after setup() run the host benchmarks and stop,
+ *                     see bench.h
+ *
+ *   Virtual command station, see station.h
+ *     -S              answer on Loconet like a command station
+ *     -D <us>         time per accessory command (20000)
+ *     -Q <n>          accessory commands it can queue (32)
+ *     -p <percent>    accessory commands lost (0)
+ *     -R <seed>       for losses and initial turnout positions (1)
+ *     -n <count>      after the sync, set turnouts 1..count through
+ *                     sendOPC_SW_REQ(), to see how the pacing scales
+ *
+ * ------------------------------------------------------------------------- */
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <LiquidCrystal_I2C.h>
+#include <LocoNet.h>
+#include "bench.h"
+#include "sim.h"
+#include "station.h"
+#include "GAW_MR_defines.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+void setup();
+void loop();
+void sendOPC_SW_REQ(int address, byte dir, byte on);
+int  txDepth();
+extern byte syncPhase;
+
+EEPROMClass EEPROM;
+extern LiquidCrystal_I2C display;
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                      EEPROM image on disk
+ * ------------------------------------------------------------------------- */
+static void eepromLoad(const char *file) {
+  FILE *f = fopen(file, "rb");
+  if (!f) return;                           // Fresh, erased EEPROM
+  if (fread(EEPROM.mem, 1, sizeof EEPROM.mem, f) != sizeof EEPROM.mem) {
+    fprintf(stderr, "sim: %s is not a full EEPROM image\n", file);
+  }
+  fclose(f);
+}
+
+static void eepromSave(const char *file) {
+  FILE *f = fopen(file, "wb");
+  if (!f) {
+    perror(file);
+    return;
+  }
+  fwrite(EEPROM.mem, 1, sizeof EEPROM.mem, f);
+  fclose(f);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                           Frames sent
+ * Every frame the sketch sends from frameFrom on, as "frame <ms> <hex>",
+ * then on to the command station, if any
+ * ------------------------------------------------------------------------- */
+static unsigned long frameFrom = 0;
+static void (*frameNext)(const uint8_t *frame) = nullptr;
+
+static void frameLog(const uint8_t *frame) {
+  if (simTime >= frameFrom) {
+    printf("frame %10.3f", simTime / 1e3);
+    for (int i = 0; i < getLnMsgSize((lnMsg *)frame); i++) printf(" %02X", frame[i]);
+    printf("\n");
+  }
+  if (frameNext) frameNext(frame);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                     Turnouts at scale
+ * Feeds the sketch's send queue like syncState() does, but for any number
+ * of turnouts, and notes when each one is set by the station
+ * ------------------------------------------------------------------------- */
+#define TX_FEED 8                           // Keep the send queue this full
+
+static int scaleCount = 0;                  // Turnouts to set, 0 = off
+static int scaleNext = 0;                   // Next one to request
+static unsigned long scaleStart = 0;
+static std::vector<unsigned long> scaleAsked; // Per turnout, 0 = not yet
+static std::vector<unsigned long> scaleSet;
+
+static void scaleSwitched(uint16_t address, unsigned long at) {
+  if (address >= 1 && address <= scaleCount && scaleAsked[address - 1] &&
+      !scaleSet[address - 1]) {
+    scaleSet[address - 1] = at;
+  }
+}
+
+static void scaleFeed() {
+  if (scaleNext >= scaleCount || syncPhase != SYNC_DONE) return;
+  if (scaleNext == 0) scaleStart = simTime;
+  while (scaleNext < scaleCount && txDepth() < TX_FEED) {
+    scaleAsked[scaleNext] = simTime;
+    sendOPC_SW_REQ(scaleNext, scaleNext & 1 ? STRAIGHT : THROWN, 1);
+    scaleNext++;
+  }
+}
+
+static void scaleReport() {
+  std::vector<unsigned long> latency;
+  unsigned long last = 0;
+  for (int i = 0; i < scaleNext; i++) {
+    if (!scaleSet[i]) continue;
+    latency.push_back(scaleSet[i] - scaleAsked[i]);
+    last = std::max(last, scaleSet[i]);
+  }
+  std::sort(latency.begin(), latency.end());
+
+  printf("scale         %d turnouts, %d requested, %lu set",
+         scaleCount, scaleNext, (unsigned long)latency.size());
+  if (!latency.empty()) {
+    printf(" in %.3f s, %.1f per s\n", (last - scaleStart) / 1e6,
+           latency.size() / ((last - scaleStart) / 1e6));
+    printf("  asked->set  p50 %.1f, p99 %.1f, max %.1f ms\n",
+           latency[(latency.size() - 1) / 2] / 1e3,
+           latency[(latency.size() - 1) * 99 / 100] / 1e3,
+           latency.back() / 1e3);
+  } else {
+    printf("\n");
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                               Arguments
+ * <ms>:<rest>, returns the time in microseconds and rest
+ * ------------------------------------------------------------------------- */
+static bool timed(const char *arg, unsigned long &at, std::string &rest) {
+  const char *colon = strchr(arg, ':');
+  if (!colon) return false;
+  at = strtoul(arg, nullptr, 10) * 1000;
+  rest = colon + 1;
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+    "usage: gaw_mr_sim [-t s] [-l us] [-k ms:code]... [-c ms:text]...\n"
+    "                  [-e eeprom.bin] [-a hexaddr]... [-q] [-f ms] [-B]\n"
+    "                  [-C ms:percent]...\n"
+    "                  [-S [-D us] [-Q n] [-p percent] [-R seed] [-n count]]\n");
+  exit(2);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                    main()
+ * ------------------------------------------------------------------------- */
+int main(int argc, char **argv) {
+  double seconds = 10;
+  unsigned long loopCost = 50;
+  const char *eepromFile = nullptr;
+  bool station = false;
+  bool frames = false;
+  bool bench = false;
+  StationConfig config;
+
+  int opt;
+  unsigned long at;
+  std::string rest;
+  while ((opt = getopt(argc, argv, "t:l:k:c:e:a:qf:BC:SD:Q:p:R:n:")) != -1) {
+    switch (opt) {
+      case 't': seconds = atof(optarg); break;
+      case 'l': loopCost = strtoul(optarg, nullptr, 10); break;
+      case 'e': eepromFile = optarg; break;
+      case 'a': simI2cAbsent(strtoul(optarg, nullptr, 16)); break;
+      case 'q': simQuiet = true; break;
+      case 'f': frames = true; frameFrom = strtoul(optarg, nullptr, 10) * 1000; break;
+      case 'B': bench = true; break;
+      case 'S': station = true; break;
+      case 'D': config.serviceUs = strtoul(optarg, nullptr, 10); break;
+      case 'Q': config.queueSize = atoi(optarg); break;
+      case 'p': config.dropPercent = atoi(optarg); break;
+      case 'R': config.seed = strtoul(optarg, nullptr, 10); break;
+      case 'n': scaleCount = atoi(optarg); break;
+
+      case 'k':
+        if (!timed(optarg, at, rest)) usage();
+        simKey(at, atoi(rest.c_str()));
+        break;
+
+      case 'c':
+        if (!timed(optarg, at, rest)) usage();
+        simSerial(at, rest.c_str());
+        break;
+
+      case 'C':
+        if (!timed(optarg, at, rest)) usage();
+        simLoconetCollisions(at, atoi(rest.c_str()));
+        break;
+
+      default:
+        usage();
+    }
+  }
+  if (loopCost == 0) loopCost = 1;          // Time must go on
+  if (scaleCount > 0 && !station) {
+    fprintf(stderr, "sim: -n needs the command station, -S\n");
+    usage();
+  }
+
+  if (eepromFile) eepromLoad(eepromFile);
+  if (station) {
+    stationBegin(config);
+    stationSwitched = scaleSwitched;
+    scaleAsked.assign(scaleCount, 0);
+    scaleSet.assign(scaleCount, 0);
+  }
+  if (frames) {                             // In front of the station
+    frameNext = simLoconetTap;
+    simLoconetTap = frameLog;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  setup();
+  unsigned long setupTime = simTime;
+  if (bench) {
+    benchRun();
+    return 0;
+  }
+
+  unsigned long end = simTime + (unsigned long)(seconds * 1e6);
+  unsigned long loops = 0;
+  unsigned long synced = 0;
+  while (simTime < end) {
+    loop();
+    simAdvance(loopCost);
+    loops++;
+    if (!synced && syncPhase == SYNC_DONE) synced = simTime;
+    if (scaleCount) scaleFeed();
+  }
+
+  double host = std::chrono::duration<double>(
+                  std::chrono::steady_clock::now() - start).count();
+
+  if (eepromFile) eepromSave(eepromFile);
+
+  printf("\n=== simulation ===\n");
+  printf("virtual time  %.3f s (setup %.3f s)\n", simTime / 1e6, setupTime / 1e6);
+  printf("host time     %.3f s, %.0fx real time\n", host, simTime / 1e6 / host);
+  printf("loop()        %lu passes, %.0f per host second\n", loops, loops / host);
+  printf("Loconet       %lu frames sent, %lu received, %lu collisions\n",
+         simLnSent, simLnReceived, simLnCollisions);
+  printf("I2C           %lu transmissions, %lu bytes\n", simI2cTransactions, simI2cBytes);
+  for (int a = 0; a < 128; a++) {
+    const SimI2cDevice &d = simI2c[a];
+    if (d.transmissions == 0) continue;
+    printf("  0x%02x        %lu / %lu, bus %.1f ms, %.2f%% of the time\n", a,
+           d.transmissions, d.bytes, d.busUs / 1e3, 100.0 * d.busUs / simTime);
+  }
+  if (synced) {
+    printf("sync          done %.3f s after setup\n", (synced - setupTime) / 1e6);
+  } else {
+    printf("sync          not done\n");
+  }
+  if (station) stationReport();
+  if (scaleCount) scaleReport();
+  printf("display\n");
+  for (int row = 0; row < 4; row++) {
+    printf("  |%s|\n", display.line(row));
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+# --------------------------------------------------------------------------- #
+# Turn the sketch into C++, the way the Arduino builder does
+#   cmake -DINO=<sketch.ino> -DOUT=<sketch.cpp> -P prototypes.cmake
+#
+# Functions in the .ino may be used before they are defined, the builder
+# adds a prototype for each of them in front of the first definition.
+# Function definitions are recognised as they are written in this sketch:
+# on one line, with the opening brace on the same line. Indented lines
+# starting with a statement keyword are statements, not definitions.
+# #line directives keep compiler messages pointing into the .ino.
+# --------------------------------------------------------------------------- #
+if(NOT INO OR NOT OUT)
+  message(FATAL_ERROR "usage: cmake -DINO=<sketch.ino> -DOUT=<sketch.cpp> -P prototypes.cmake")
+endif()
+
+file(READ ${INO} src)
+
+string(REGEX MATCHALL
+  "\n[ \t]*[A-Za-z_][A-Za-z0-9_]*[ \t*&]+[A-Za-z0-9_ \t*&]*\\([^;{}()]*\\)[ \t]*{"
+  matches "${src}")
+
+set(definitions "")
+foreach(match IN LISTS matches)
+  if(NOT match MATCHES "^\n[ \t]*(if|else|for|while|switch|return|do|case)[^A-Za-z0-9_]")
+    list(APPEND definitions "${match}")
+  endif()
+endforeach()
+if(NOT definitions)
+  message(FATAL_ERROR "${INO}: no function definitions found")
+endif()
+
+set(prototypes "")
+foreach(definition IN LISTS definitions)
+  string(REGEX REPLACE "^\n[ \t]*" "" proto "${definition}")
+  string(REGEX REPLACE "[ \t]*{$" ";" proto "${proto}")
+  set(prototypes "${prototypes}${proto}\n")
+endforeach()
+
+list(GET definitions 0 first)
+string(FIND "${src}" "${first}" at)
+math(EXPR at "${at} + 1")                   # Keep the newline in front
+string(SUBSTRING "${src}" 0 ${at} head)
+string(SUBSTRING "${src}" ${at} -1 tail)
+
+string(REGEX MATCHALL "\n" lines "${head}")
+list(LENGTH lines line)
+math(EXPR line "${line} + 1")
+
+file(WRITE ${OUT}
+  "#include <Arduino.h>\n"
+  "#line 1 \"${INO}\"\n"
+  "${head}"
+  "${prototypes}"
+  "#line ${line} \"${INO}\"\n"
+  "${tail}")
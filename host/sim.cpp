@@ -0,0 +1,69 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Host simulation of GAW_MR-control: virtual clock and scripted input
+ *
+ * ------------------------------------------------------------------------- */
+#include "sim.h"
+
+#include <string>
+#include <map>
+
+
+unsigned long simTime = 0;
+bool simQuiet = false;
+
+static std::multimap<unsigned long, char> keys;       // Pending key presses
+static std::multimap<unsigned long, std::string> lines; // Pending serial input
+static std::string serialIn;                          // Typed, not yet read
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                              simAdvance()
+ * ------------------------------------------------------------------------- */
+void simAdvance(unsigned long us) {
+  simTime += us;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                    simKey(), simKeyDue()
+ * One key per call, just like Keypad::getKey() returns one key at a time
+ * ------------------------------------------------------------------------- */
+void simKey(unsigned long at, char code) {
+  keys.insert(std::make_pair(at, code));
+}
+
+char simKeyDue() {
+  if (keys.empty() || keys.begin()->first > simTime) return 0;
+  char code = keys.begin()->second;
+  keys.erase(keys.begin());
+  return code;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                            simSerial(), simSerialAvailable(), simSerialRead()
+ * ------------------------------------------------------------------------- */
+void simSerial(unsigned long at, const char *text) {
+  lines.insert(std::make_pair(at, std::string(text) + "\n"));
+}
+
+static void serialDue() {
+  while (!lines.empty() && lines.begin()->first <= simTime) {
+    serialIn += lines.begin()->second;
+    lines.erase(lines.begin());
+  }
+}
+
+int simSerialAvailable() {
+  serialDue();
+  return serialIn.size();
+}
+
+int simSerialRead() {
+  serialDue();
+  if (serialIn.empty()) return -1;
+  int c = (unsigned char)serialIn[0];
+  serialIn.erase(0, 1);
+  return c;
+}
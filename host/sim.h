@@ -0,0 +1,63 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Host simulation of GAW_MR-control: virtual clock and scripted input
+ *
+ * All stand-in libraries take their time from simTime. Time passes by
+ * simAdvance(): the simulation adds a fixed cost per loop(), the stand-ins
+ * add the time the real hardware would block (delay(), I2C transfers,
+ * sending on Loconet). Input is scheduled up front and becomes visible to
+ * the sketch when the virtual clock gets there.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                             Virtual clock
+ * ------------------------------------------------------------------------- */
+extern unsigned long simTime;               // Virtual time in microseconds
+
+void simAdvance(unsigned long us);
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            Scripted input
+ * at is the virtual time in microseconds
+ * ------------------------------------------------------------------------- */
+void simKey(unsigned long at, char code);   // Press the key with this code
+void simSerial(unsigned long at, const char *text); // Type a line
+
+char simKeyDue();                           // For Keypad, 0 = none
+int  simSerialAvailable();                  // For Serial
+int  simSerialRead();
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                          Loconet and I2C
+ * ------------------------------------------------------------------------- */
+void simLoconetReceive(unsigned long at, const uint8_t *frame); // Queue a frame
+void simI2cAbsent(uint8_t address);         // Device does not answer
+void simLoconetCollisions(unsigned long at, int percent); // Of the sends
+                                            //  from at on, until changed
+
+extern void (*simLoconetTap)(const uint8_t *frame); // Sees frames sent
+
+extern unsigned long simLnSent;             // Frames sent by the sketch
+extern unsigned long simLnReceived;         // Frames given to the sketch
+extern unsigned long simLnCollisions;       // Sends that collided
+extern unsigned long simI2cTransactions;    // I2C transmissions
+extern unsigned long simI2cBytes;           //  and bytes, incl. address
+
+struct SimI2cDevice {                       // I2C traffic per address
+  unsigned long transmissions;
+  unsigned long bytes;
+  unsigned long busUs;                      // Time the bus was busy
+};
+extern SimI2cDevice simI2c[128];
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                    Output
+ * ------------------------------------------------------------------------- */
+extern bool simQuiet;                       // Suppress Serial output
@@ -0,0 +1,41 @@
+# --------------------------------------------------------------------------- #
+# Run the simulation and check its output, for ctest
+#   cmake -DSIM=<gaw_mr_sim> -DARGS=<options> -DEXPECT=<regexes>
+#         [-DREJECT=<regexes>] -P simtest.cmake
+#
+# ARGS, EXPECT and REJECT are lists, separated by semicolons. The test
+# fails when the simulation fails, when one of the EXPECT expressions is
+# not found in the output, or when one of the REJECT expressions is.
+# The output is shown on failure (ctest --output-on-failure).
+# --------------------------------------------------------------------------- #
+if(NOT SIM OR NOT EXPECT)
+  message(FATAL_ERROR "usage: cmake -DSIM=<gaw_mr_sim> -DARGS=<options> -DEXPECT=<regexes> [-DREJECT=<regexes>] -P simtest.cmake")
+endif()
+
+execute_process(
+  COMMAND ${SIM} ${ARGS}
+  OUTPUT_VARIABLE out
+  ERROR_VARIABLE  out
+  RESULT_VARIABLE status)
+
+message("${out}")
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "gaw_mr_sim exited with ${status}")
+endif()
+
+set(failed "")
+foreach(regex IN LISTS EXPECT)
+  if(NOT out MATCHES "${regex}")
+    list(APPEND failed "expected: ${regex}")
+  endif()
+endforeach()
+foreach(regex IN LISTS REJECT)
+  if(out MATCHES "${regex}")
+    list(APPEND failed "not expected: ${regex}")
+  endif()
+endforeach()
+
+if(failed)
+  string(REPLACE ";" "\n  " failed "${failed}")
+  message(FATAL_ERROR "output check failed:\n  ${failed}")
+endif()
@@ -0,0 +1,195 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Virtual command station, host simulation
+ *
+ * The accessory queue is computed ahead: when a command arrives its start
+ * (when the one before it is done) and finish time are known, so the
+ * report can be put in the Loconet receive queue right away. Positions
+ * change at the finish time, settle() applies them before the station
+ * answers a query.
+ *
+ * ------------------------------------------------------------------------- */
+#include "station.h"
+#include "sim.h"
+
+#include <LocoNet.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+
+void (*stationSwitched)(uint16_t address, unsigned long at) = nullptr;
+
+struct Command {
+  uint16_t address;
+  bool straight;
+  unsigned long finish;
+};
+
+static StationConfig cfg;
+static std::mt19937 rng;
+static std::deque<Command> pending;         // Not executed yet, by finish
+static std::vector<uint8_t> known;          // Per address: 0 = unseen,
+                                            //  1 = thrown, 2 = straight
+static bool power = false;
+static unsigned long busyUntil = 0;         // Accessory output free again
+
+static unsigned long received = 0;          // Statistics
+static unsigned long executed = 0;
+static unsigned long dropped = 0;
+static unsigned long overflowed = 0;
+static unsigned long queries = 0;
+static unsigned long lastExecuted = 0;
+static size_t depthMax = 0;
+static std::vector<unsigned long> waits;    // Arrival to start, us
+static std::vector<unsigned long> latencies; // Arrival to report back, us
+
+#define FRAME_US(n) ((n) * 10UL * LN_BIT_US) // Time on the wire
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            stationBegin()
+ * ------------------------------------------------------------------------- */
+void stationBegin(const StationConfig &config) {
+  cfg = config;
+  rng.seed(cfg.seed);
+  known.assign(2048, 0);
+  simLoconetTap = stationFrame;
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                       position(), reply()
+ * Turnouts the station did not set yet are where they were left, which
+ * the station knows but we do not: a random position
+ * ------------------------------------------------------------------------- */
+static bool position(uint16_t address) {
+  uint8_t &p = known[address & 0x7FF];
+  if (p == 0) p = (rng() & 1) ? 2 : 1;
+  return p == 2;
+}
+
+static unsigned long reply(unsigned long from, uint8_t op, uint8_t d1, uint8_t d2) {
+  uint8_t frame[4] = { op, d1, d2, 0 };
+  uint8_t size = getLnMsgSize((lnMsg *)frame);
+  uint8_t check = 0xFF;
+  for (int i = 0; i < size - 1; i++) check ^= frame[i];
+  frame[size - 1] = check;
+
+  unsigned long at = from + cfg.replyUs + FRAME_US(size);
+  simLoconetReceive(at, frame);
+  return at;                                // When the sketch has it
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                                  settle()
+ * Execute the commands that are done by now
+ * ------------------------------------------------------------------------- */
+static void settle(unsigned long now) {
+  while (!pending.empty() && pending.front().finish <= now) {
+    const Command &c = pending.front();
+    known[c.address & 0x7FF] = c.straight ? 2 : 1;
+    executed++;
+    lastExecuted = c.finish;
+    if (stationSwitched) stationSwitched(c.address, c.finish);
+    pending.pop_front();
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            switchRequest()
+ * ------------------------------------------------------------------------- */
+static void switchRequest(uint16_t address, bool straight) {
+  unsigned long now = simTime;
+  received++;
+  settle(now);
+
+  if ((int)pending.size() >= cfg.queueSize) {
+    overflowed++;
+    return;
+  }
+  if (cfg.dropPercent > 0 && (int)(rng() % 100) < cfg.dropPercent) {
+    dropped++;
+    return;
+  }
+
+  Command c;
+  c.address  = address;
+  c.straight = straight;
+  unsigned long start = std::max(now, busyUntil);
+  c.finish   = start + cfg.serviceUs;
+  busyUntil  = c.finish;
+  pending.push_back(c);
+  depthMax = std::max(depthMax, pending.size());
+
+  uint16_t a = address - 1;                 // SW_REP, input bit: position
+  unsigned long at = reply(c.finish, OPC_SW_REP, a & 0x7F,
+                           ((a >> 7) & 0x0F) | OPC_SW_REP_INPUTS |
+                           OPC_SW_REP_HI | (straight ? OPC_SW_REP_SW : 0));
+
+  waits.push_back(start - now);
+  latencies.push_back(at - now);
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                            stationFrame()
+ * ------------------------------------------------------------------------- */
+void stationFrame(const uint8_t *frame) {
+  uint8_t d1 = frame[1];
+  uint8_t d2 = frame[2];
+  uint16_t address = (d1 | ((d2 & 0x0F) << 7)) + 1;
+
+  switch (frame[0]) {
+    case OPC_SW_REQ:
+      if (d2 & OPC_SW_REQ_OUT) switchRequest(address, d2 & OPC_SW_REQ_DIR);
+      break;
+
+    case OPC_SW_STATE:
+      queries++;
+      settle(simTime);
+      reply(simTime, OPC_LONG_ACK, OPC_SW_STATE & 0x7F, position(address) ? 0x30 : 0x50);
+      break;
+
+    case OPC_GPON:
+    case OPC_GPOFF:
+      power = frame[0] == OPC_GPON;
+      reply(simTime, frame[0], 0, 0);
+      break;
+
+    default:
+      break;
+  }
+}
+
+
+/* ------------------------------------------------------------------------- *
+ *                                                           stationReport()
+ * ------------------------------------------------------------------------- */
+static unsigned long percentile(std::vector<unsigned long> v, int p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[(v.size() - 1) * p / 100];
+}
+
+void stationReport() {
+  settle(simTime);
+  printf("station       power %s, %lu queries answered\n", power ? "on" : "off", queries);
+  printf("  switches    %lu requested, %lu executed, %lu waiting\n",
+         received, executed, (unsigned long)pending.size());
+  printf("              %lu dropped, %lu lost on a full queue (max %lu deep)\n",
+         dropped, overflowed, (unsigned long)depthMax);
+  if (executed) {
+    printf("              last one set at %.3f s\n", lastExecuted / 1e6);
+  }
+  printf("  queued      p50 %.1f, p99 %.1f, max %.1f ms\n",
+         percentile(waits, 50) / 1e3, percentile(waits, 99) / 1e3,
+         percentile(waits, 100) / 1e3);
+  printf("  to report   p50 %.1f, p99 %.1f, max %.1f ms\n",
+         percentile(latencies, 50) / 1e3, percentile(latencies, 99) / 1e3,
+         percentile(latencies, 100) / 1e3);
+}
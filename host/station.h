@@ -0,0 +1,33 @@
+/* ------------------------------------------------------------------------- *
+ *
+ * Virtual command station, host simulation
+ *
+ * Stands in for the Z21 on the other end of Loconet. It sees every frame
+ * the sketch sends and answers on the virtual clock:
+ *   OPC_SW_REQ   - queued, executed one at a time taking serviceUs each
+ *                  (the DCC accessory packets), then an OPC_SW_REP with
+ *                  the new position is sent. A full queue or bad luck
+ *                  (dropPercent) loses the command, without a report.
+ *   OPC_SW_STATE - answered with an OPC_LONG_ACK holding the position
+ *   OPC_GPON/OFF - power switched and the new state broadcast
+ * Replies take replyUs plus their time on the wire. Requests with the
+ * output bit off only end the pulse, they are not queued.
+ *
+ * ------------------------------------------------------------------------- */
+#pragma once
+#include <stdint.h>
+
+struct StationConfig {
+  unsigned long serviceUs   = 20000;        // Per accessory command
+  int           queueSize   = 32;           // Accessory commands waiting
+  int           dropPercent = 0;            // Commands lost on the way
+  unsigned long replyUs     = 2000;         // Before a reply is sent
+  unsigned int  seed        = 1;            // Drops, initial positions
+};
+
+void stationBegin(const StationConfig &config);
+void stationFrame(const uint8_t *frame);    // Frame sent by the sketch
+void stationReport();
+
+// Called when a turnout is set, at the virtual time it happens
+extern void (*stationSwitched)(uint16_t address, unsigned long at);